@@ -0,0 +1,357 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 23 Apr 2024 9:12:30pm
+    Author:  MacBook Pro
+
+    Microbenchmarks for the DSP on Specter's audio path, over a grid of block
+    sizes, channel counts and sample rates. Results go out as JSON so runs on
+    different commits and machines can be compared. Build in Release.
+
+        SpecterBenchmarks [--out results.json] [--label name] [--filter kernel]
+                          [--quick] [--seconds-per-case 0.05]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+namespace
+{
+    struct Settings
+    {
+        juce::File outputFile;
+        juce::String label, filter;
+        double secondsPerCase = 0.05;
+        juce::Array<int> blockSizes { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+        juce::Array<int> channelCounts { 1, 2 };
+        juce::Array<double> sampleRates { 44100.0, 48000.0, 96000.0 };
+    };
+
+    struct Case
+    {
+        int blockSize, numChannels;
+        double sampleRate;
+    };
+
+    // Runs fn in batches until the time is up and returns nanoseconds per
+    // call. reset, if there is one, runs before every batch and isn't timed.
+    // Denormals are flushed, as they are in processBlock.
+    template <typename Fn>
+    double timePerCall(Fn&& fn, const std::function<void()>& reset, double seconds, int& calls)
+    {
+        constexpr int callsPerBatch = 8;
+        const juce::ScopedNoDenormals noDenormals;
+
+        for (int i = 0; i < 16; ++i) // Warm up caches and clocks
+            fn();
+
+        calls = 0;
+        const auto limit = juce::Time::secondsToHighResolutionTicks(seconds);
+        juce::int64 timed = 0;
+
+        while (timed < limit)
+        {
+            if (reset != nullptr)
+                reset();
+
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            for (int i = 0; i < callsPerBatch; ++i)
+                fn();
+
+            timed += juce::Time::getHighResolutionTicks() - start;
+            calls += callsPerBatch;
+        }
+
+        return juce::Time::highResolutionTicksToSeconds(timed) * 1.0e9 / calls;
+    }
+
+    void fillWithNoise(juce::AudioBuffer<float>& buffer, juce::Random& random)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(channel, i, random.nextFloat() * 2.0f - 1.0f);
+    }
+
+    std::vector<short> noiseAsShorts(int numSamples, juce::Random& random)
+    {
+        std::vector<short> samples((size_t) numSamples);
+
+        for (auto& s : samples)
+            s = (short) (random.nextInt(65536) - 32768);
+
+        return samples;
+    }
+
+    //==============================================================================
+    class Suite
+    {
+    public:
+        explicit Suite(const Settings& s) : settings(s) {}
+
+        void run()
+        {
+            for (auto sampleRate : settings.sampleRates)
+                for (auto numChannels : settings.channelCounts)
+                    for (auto blockSize : settings.blockSizes)
+                        runCase({ blockSize, numChannels, sampleRate });
+        }
+
+        juce::var getResults() const { return juce::var(results); }
+
+    private:
+        // Everything is run per channel the way the processor does, so the
+        // figures add up to what one block of the audio callback costs
+        void runCase(const Case& c)
+        {
+            juce::Random random(1234);
+            juce::AudioBuffer<float> buffer(c.numChannels, c.blockSize);
+            fillWithNoise(buffer, random);
+
+            // int16 helpers, kept for the legacy offline path
+            measure("convertToShort", c, [&]
+            {
+                for (int channel = 0; channel < c.numChannels; ++channel)
+                    juce::ignoreUnused(SpecterAudioProcessor::convertToShort(buffer, channel));
+            });
+
+            const auto shorts = noiseAsShorts(c.blockSize, random);
+            measure("convertToFloat", c, [&]
+            {
+                for (int channel = 0; channel < c.numChannels; ++channel)
+                    SpecterAudioProcessor::convertToFloat(buffer, shorts, channel);
+            });
+
+            // Oscillator: the int16 helpers and the float path processBlock uses
+            SampleOscillator oscillator;
+            oscillator.prepare(c.sampleRate);
+
+            measure("SampleOscillator::oscillateBuffer", c, [&]
+            {
+                for (int channel = 0; channel < c.numChannels; ++channel)
+                    juce::ignoreUnused(oscillator.oscillateBuffer(shorts));
+            });
+
+            std::vector<short> mixed;
+            measure("SampleOscillator::processAndMixBuffers", c, [&]
+            {
+                for (int channel = 0; channel < c.numChannels; ++channel)
+                    oscillator.processAndMixBuffers(shorts, shorts, shorts, shorts, mixed);
+            });
+
+            measure("SampleOscillator::process", c, [&] { oscillator.process(buffer, c.blockSize); },
+                    [&] { fillWithNoise(buffer, random); });
+
+            // Effects
+            juce::dsp::ProcessSpec spec { c.sampleRate, (juce::uint32) c.blockSize, (juce::uint32) c.numChannels };
+
+            LowPassFilterEffect filter;
+            filter.prepare(spec);
+            filter.updateParameters(2000.0f, 0.707f);
+            measure("LowPassFilterEffect::process", c, [&] { filter.process(buffer); },
+                    [&] { fillWithNoise(buffer, random); });
+
+            ReverbEffect reverb;
+            reverb.prepare(spec);
+            reverb.updateParameters(0.7f, 0.5f, 0.33f, 0.4f, 1.0f, 0.0f);
+            measure("ReverbEffect::process", c, [&] { reverb.process(buffer); },
+                    [&] { fillWithNoise(buffer, random); });
+
+            // The four-corner mix in processBlock, and the four addFrom passes it replaced
+            juce::AudioBuffer<float> corners[BilinearMix::numCorners];
+            for (auto& corner : corners)
+            {
+                corner.setSize(c.numChannels, c.blockSize);
+                fillWithNoise(corner, random);
+            }
+
+            const float weights[] = { 0.1f, 0.2f, 0.3f, 0.4f };
+            const float endWeights[] = { 0.4f, 0.3f, 0.2f, 0.1f };
+            buffer.clear();
+
+            measure("mix/addFrom x4", c, [&]
+            {
+                for (int corner = 0; corner < BilinearMix::numCorners; ++corner)
+                    for (int channel = 0; channel < c.numChannels; ++channel)
+                        buffer.addFrom(channel, 0, corners[corner], channel, 0, c.blockSize, weights[corner]);
+            }, [&] { buffer.clear(); });
+
+            measure("mix/BilinearMix", c, [&]
+            {
+                BilinearMix::addToBuffer(buffer, corners, weights, c.blockSize);
+            }, [&] { buffer.clear(); });
+
+            measure("mix/BilinearMix ramped", c, [&]
+            {
+                BilinearMix::addToBuffer(buffer, corners, weights, endWeights, 0, c.blockSize);
+            }, [&] { buffer.clear(); });
+
+            // All four corners' filters at once, to set against the one
+            // LowPassFilterEffect above. Every lane in a different mode, driven.
+            CornerFilterBank cornerFilters;
+            cornerFilters.prepare(c.sampleRate, c.blockSize, c.numChannels);
+
+            for (int corner = 0; corner < CornerFilterBank::numCorners; ++corner)
+            {
+                CornerFilterBank::CornerSettings cornerSettings;
+                cornerSettings.mode = static_cast<CornerFilterBank::Mode>(corner);
+                cornerSettings.cutoff = 500.0f * (float) (corner + 1);
+                cornerSettings.resonance = 1.0f;
+                cornerSettings.drive = 0.5f;
+                cornerFilters.setCorner(corner, cornerSettings);
+            }
+
+            const auto refillCorners = [&]
+            {
+                for (auto& corner : corners)
+                    fillWithNoise(corner, random);
+            };
+
+            measure("CornerFilterBank::process", c, [&] { cornerFilters.process(corners, 0, c.blockSize); }, refillCorners);
+        }
+
+        // Times fn and records the result. reset, if given, runs before every
+        // few calls, outside the timing, to put the input back and keep
+        // accumulating kernels from growing without bound.
+        template <typename Fn>
+        void measure(const juce::String& kernel, const Case& c, Fn&& fn, std::function<void()> reset = nullptr)
+        {
+            if (settings.filter.isNotEmpty() && ! kernel.containsIgnoreCase(settings.filter))
+                return;
+
+            if (reset != nullptr)
+                reset();
+
+            int calls = 0;
+            const auto nsPerBlock = timePerCall(fn, reset, settings.secondsPerCase, calls);
+            const auto budgetNs = c.blockSize / c.sampleRate * 1.0e9;
+
+            auto* result = new juce::DynamicObject();
+            result->setProperty("kernel", kernel);
+            result->setProperty("blockSize", c.blockSize);
+            result->setProperty("channels", c.numChannels);
+            result->setProperty("sampleRate", c.sampleRate);
+            result->setProperty("nsPerBlock", nsPerBlock);
+            result->setProperty("nsPerSample", nsPerBlock / (c.blockSize * c.numChannels));
+            result->setProperty("percentOfBlockBudget", 100.0 * nsPerBlock / budgetNs);
+            result->setProperty("iterations", calls);
+            results.add(juce::var(result));
+
+            std::cerr << kernel << "  " << c.blockSize << " x " << c.numChannels << " @ " << c.sampleRate
+                      << "  " << juce::String(nsPerBlock, 1) << " ns\n";
+        }
+
+        const Settings& settings;
+        juce::Array<juce::var> results;
+    };
+
+    // Largest difference between the vectorised mix and the scalar reference,
+    // so a fast but wrong kernel shows up in the results
+    double mixKernelError()
+    {
+        juce::Random random(99);
+        constexpr int numSamples = 1027; // Not a multiple of the vector width, to cover the tail
+        std::vector<float> corners[BilinearMix::numCorners];
+        const float* cornerData[BilinearMix::numCorners];
+
+        for (int c = 0; c < BilinearMix::numCorners; ++c)
+        {
+            corners[c].resize(numSamples);
+            for (auto& s : corners[c])
+                s = random.nextFloat() * 2.0f - 1.0f;
+            cornerData[c] = corners[c].data();
+        }
+
+        const float start[] = { 0.1f, 0.2f, 0.3f, 0.4f }, end[] = { 0.4f, 0.3f, 0.2f, 0.1f };
+        std::vector<float> scalar((size_t) numSamples, 0.0f), vectorised((size_t) numSamples, 0.0f);
+        BilinearMix::addScalar(scalar.data(), cornerData, start, numSamples);
+        BilinearMix::addVectorised(vectorised.data(), cornerData, start, numSamples);
+        BilinearMix::addRampedScalar(scalar.data(), cornerData, start, end, numSamples);
+        BilinearMix::addRampedVectorised(vectorised.data(), cornerData, start, end, numSamples);
+
+        double maxError = 0.0;
+        for (size_t i = 0; i < scalar.size(); ++i)
+            maxError = juce::jmax(maxError, (double) std::abs(scalar[i] - vectorised[i]));
+
+        return maxError;
+    }
+
+    juce::var describeMachine(const Settings& settings)
+    {
+        auto* machine = new juce::DynamicObject();
+        machine->setProperty("cpu", juce::SystemStats::getCpuModel());
+        machine->setProperty("cpuVendor", juce::SystemStats::getCpuVendor());
+        machine->setProperty("logicalCpus", juce::SystemStats::getNumCpus());
+        machine->setProperty("os", juce::SystemStats::getOperatingSystemName());
+        machine->setProperty("sse2", juce::SystemStats::hasSSE2());
+        machine->setProperty("avx", juce::SystemStats::hasAVX());
+        machine->setProperty("neon", juce::SystemStats::hasNeon());
+
+        auto* run = new juce::DynamicObject();
+        run->setProperty("label", settings.label);
+        run->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+        run->setProperty("juceVersion", juce::SystemStats::getJUCEVersion());
+        run->setProperty("secondsPerCase", settings.secondsPerCase);
+       #if JUCE_DEBUG
+        run->setProperty("build", "Debug");
+       #else
+        run->setProperty("build", "Release");
+       #endif
+        run->setProperty("mixKernelMaxError", mixKernelError());
+        run->setProperty("machine", juce::var(machine));
+        return juce::var(run);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg(juce::CharPointer_UTF8(argv[i]));
+        const auto next = [&] { return i + 1 < argc ? juce::String(juce::CharPointer_UTF8(argv[++i])) : juce::String(); };
+
+        if (arg == "--out")                    settings.outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(next());
+        else if (arg == "--label")             settings.label = next();
+        else if (arg == "--filter")            settings.filter = next();
+        else if (arg == "--seconds-per-case")  settings.secondsPerCase = next().getDoubleValue();
+        else if (arg == "--quick")
+        {
+            settings.blockSizes = { 64, 512, 4096 };
+            settings.channelCounts = { 2 };
+            settings.sampleRates = { 48000.0 };
+        }
+        else
+        {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    Suite suite(settings);
+    suite.run();
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty("run", describeMachine(settings));
+    root->setProperty("results", suite.getResults());
+    const auto json = juce::JSON::toString(juce::var(root));
+
+    if (settings.outputFile != juce::File())
+    {
+        if (! settings.outputFile.replaceWithText(json))
+        {
+            std::cerr << "Couldn't write " << settings.outputFile.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,371 @@
+/*
+  ==============================================================================
+
+    CornerFilterBank.h
+    Created: 2 May 2024 7:48:12pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+// Four-wide float vectors, one lane per corner. SSE or NEON when the build
+// has them, otherwise a plain struct the compiler can still unroll.
+namespace CornerLanes
+{
+   #if JUCE_USE_SSE_INTRINSICS
+    using Vec = __m128;
+
+    inline Vec load(const float* p) noexcept          { return _mm_load_ps(p); }
+    inline Vec loadUnaligned(const float* p) noexcept { return _mm_loadu_ps(p); }
+    inline void store(float* p, Vec v) noexcept          { _mm_store_ps(p, v); }
+    inline void storeUnaligned(float* p, Vec v) noexcept { _mm_storeu_ps(p, v); }
+    inline Vec set1(float x) noexcept          { return _mm_set1_ps(x); }
+    inline Vec add(Vec a, Vec b) noexcept      { return _mm_add_ps(a, b); }
+    inline Vec sub(Vec a, Vec b) noexcept      { return _mm_sub_ps(a, b); }
+    inline Vec mul(Vec a, Vec b) noexcept      { return _mm_mul_ps(a, b); }
+    inline Vec div(Vec a, Vec b) noexcept      { return _mm_div_ps(a, b); }
+    inline Vec clamp(Vec x, Vec lo, Vec hi) noexcept { return _mm_min_ps(_mm_max_ps(x, lo), hi); }
+
+    inline void transpose(Vec& r0, Vec& r1, Vec& r2, Vec& r3) noexcept { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+   #elif JUCE_USE_ARM_NEON
+    using Vec = float32x4_t;
+
+    inline Vec load(const float* p) noexcept          { return vld1q_f32(p); }
+    inline Vec loadUnaligned(const float* p) noexcept { return vld1q_f32(p); }
+    inline void store(float* p, Vec v) noexcept          { vst1q_f32(p, v); }
+    inline void storeUnaligned(float* p, Vec v) noexcept { vst1q_f32(p, v); }
+    inline Vec set1(float x) noexcept          { return vdupq_n_f32(x); }
+    inline Vec add(Vec a, Vec b) noexcept      { return vaddq_f32(a, b); }
+    inline Vec sub(Vec a, Vec b) noexcept      { return vsubq_f32(a, b); }
+    inline Vec mul(Vec a, Vec b) noexcept      { return vmulq_f32(a, b); }
+    inline Vec clamp(Vec x, Vec lo, Vec hi) noexcept { return vminq_f32(vmaxq_f32(x, lo), hi); }
+
+    // 32-bit NEON has no vector divide, so refine the reciprocal estimate instead
+    inline Vec div(Vec a, Vec b) noexcept
+    {
+        auto r = vrecpeq_f32(b);
+        r = vmulq_f32(r, vrecpsq_f32(b, r));
+        r = vmulq_f32(r, vrecpsq_f32(b, r));
+        return vmulq_f32(a, r);
+    }
+
+    inline void transpose(Vec& r0, Vec& r1, Vec& r2, Vec& r3) noexcept
+    {
+        const auto t01 = vtrnq_f32(r0, r1), t23 = vtrnq_f32(r2, r3);
+        r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+        r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+        r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+        r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+    }
+   #else
+    struct Vec { float v[4]; };
+
+    template <typename Op>
+    inline Vec map(Vec a, Vec b, Op op) noexcept { return { { op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]) } }; }
+
+    inline Vec load(const float* p) noexcept          { return { { p[0], p[1], p[2], p[3] } }; }
+    inline Vec loadUnaligned(const float* p) noexcept { return load(p); }
+    inline void store(float* p, Vec v) noexcept          { for (int i = 0; i < 4; ++i) p[i] = v.v[i]; }
+    inline void storeUnaligned(float* p, Vec v) noexcept { store(p, v); }
+    inline Vec set1(float x) noexcept          { return { { x, x, x, x } }; }
+    inline Vec add(Vec a, Vec b) noexcept      { return map(a, b, [] (float x, float y) { return x + y; }); }
+    inline Vec sub(Vec a, Vec b) noexcept      { return map(a, b, [] (float x, float y) { return x - y; }); }
+    inline Vec mul(Vec a, Vec b) noexcept      { return map(a, b, [] (float x, float y) { return x * y; }); }
+    inline Vec div(Vec a, Vec b) noexcept      { return map(a, b, [] (float x, float y) { return x / y; }); }
+    inline Vec clamp(Vec x, Vec lo, Vec hi) noexcept
+    {
+        return map(map(x, lo, [] (float a, float b) { return juce::jmax(a, b); }), hi, [] (float a, float b) { return juce::jmin(a, b); });
+    }
+
+    inline void transpose(Vec& r0, Vec& r1, Vec& r2, Vec& r3) noexcept
+    {
+        Vec* rows[] = { &r0, &r1, &r2, &r3 };
+        for (int i = 0; i < 4; ++i)
+            for (int j = i + 1; j < 4; ++j)
+                std::swap(rows[i]->v[j], rows[j]->v[i]);
+    }
+   #endif
+}
+
+// A drive stage and a state-variable filter for each corner, all four run
+// side by side in the lanes of one vector. The corner buffers are read four
+// samples at a time and transposed, so every vector holds the same instant
+// from all four corners; filtering all of them costs about what one scalar
+// filter would.
+//
+// The filter is the same trapezoidal SVF as LowPassFilterEffect. The mode is
+// applied as a mix of its three outputs, so every lane can be in a different
+// mode without branching. Settings glide like the bus filter's, with the
+// per-sample coefficients kept in scratch space sized in prepare().
+class CornerFilterBank
+{
+public:
+    static constexpr int numCorners = 4;
+
+    enum class Mode { lowPass, highPass, bandPass, notch };
+
+    struct CornerSettings
+    {
+        Mode mode = Mode::lowPass;
+        float cutoff = 20000.0f;  // Hz
+        float resonance = 0.7071f; // Q
+        float drive = 0.0f;        // 0 is clean, 1 is a hard push into the saturator
+    };
+
+    CornerFilterBank() = default;
+
+    // Allocates. Call before processing, off the audio thread.
+    void prepare(double newSampleRate, int maxBlockSize, int numChannels)
+    {
+        sampleRate = newSampleRate;
+        blockSize = juce::jmax(1, maxBlockSize);
+        state.assign((size_t) juce::jmax(1, numChannels), {});
+        scratch.assign((size_t) blockSize, {});
+
+        for (int corner = 0; corner < numCorners; ++corner)
+        {
+            auto& s = smoothers[corner];
+            s.cutoff.reset(sampleRate, smoothingSeconds);
+            s.resonance.reset(sampleRate, smoothingSeconds);
+            s.drive.reset(sampleRate, smoothingSeconds);
+            s.cutoff.setCurrentAndTargetValue(limitCutoff(s.cutoff.getTargetValue()));
+            s.resonance.setCurrentAndTargetValue(s.resonance.getTargetValue());
+            s.drive.setCurrentAndTargetValue(s.drive.getTargetValue());
+        }
+
+        updateFixedCoefficients();
+    }
+
+    void reset()
+    {
+        std::fill(state.begin(), state.end(), ChannelState {});
+    }
+
+    // Only sets targets, so it is fine to call every sub-block
+    void setCorner(int corner, const CornerSettings& settings)
+    {
+        jassert(juce::isPositiveAndBelow(corner, numCorners));
+        auto& s = smoothers[corner];
+        s.cutoff.setTargetValue(limitCutoff(settings.cutoff));
+        s.resonance.setTargetValue(juce::jlimit(0.05f, 40.0f, settings.resonance));
+        s.drive.setTargetValue(juce::jlimit(0.0f, 1.0f, settings.drive));
+
+        if (modes[corner] != settings.mode)
+        {
+            modes[corner] = settings.mode;
+            updateFixedCoefficients();
+        }
+    }
+
+    // Filters each corner buffer in place over the range. All four need the
+    // same number of channels.
+    void process(juce::AudioBuffer<float>* cornerBuffers, int startSample, int numSamples) noexcept
+    {
+        jassert(! scratch.empty()); // prepare() hasn't been called
+        const int numChannels = juce::jmin(cornerBuffers[0].getNumChannels(), (int) state.size());
+
+        for (int done = 0; done < numSamples;)
+        {
+            const int num = juce::jmin(numSamples - done, blockSize);
+            const bool gliding = isGliding();
+
+            if (gliding)
+            {
+                for (int i = 0; i < num; ++i)
+                {
+                    float cutoff[numCorners], resonance[numCorners], drive[numCorners];
+
+                    for (int corner = 0; corner < numCorners; ++corner)
+                    {
+                        cutoff[corner] = smoothers[corner].cutoff.getNextValue();
+                        resonance[corner] = smoothers[corner].resonance.getNextValue();
+                        drive[corner] = smoothers[corner].drive.getNextValue();
+                    }
+
+                    makeCoefficients(cutoff, resonance, drive, scratch[(size_t) i]);
+                }
+
+                fixed = scratch[(size_t) num - 1];
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                float* data[numCorners];
+
+                for (int corner = 0; corner < numCorners; ++corner)
+                    data[corner] = cornerBuffers[corner].getWritePointer(channel, startSample + done);
+
+                if (gliding)
+                    processChannel(data, num, state[(size_t) channel], [this] (int i) -> const LaneCoefficients& { return scratch[(size_t) i]; });
+                else
+                    processChannel(data, num, state[(size_t) channel], [this] (int) -> const LaneCoefficients& { return fixed; });
+            }
+
+            done += num;
+        }
+    }
+
+private:
+    // Everything one sample needs, a lane per corner
+    struct alignas(16) LaneCoefficients
+    {
+        float a1[numCorners], a2[numCorners], a3[numCorners];
+        float lowPassMix[numCorners], bandPassMix[numCorners], inputMix[numCorners];
+        float drive[numCorners], preGain[numCorners];
+    };
+
+    struct alignas(16) ChannelState
+    {
+        float ic1eq[numCorners] {}, ic2eq[numCorners] {};
+    };
+
+    struct Smoothers
+    {
+        juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> cutoff { 20000.0f };
+        juce::SmoothedValue<float> resonance { 0.7071f }, drive { 0.0f };
+    };
+
+    static constexpr double smoothingSeconds = 0.02;
+    static constexpr float maxPreGain = 8.0f;
+
+    float limitCutoff(float frequency) const
+    {
+        return juce::jlimit(10.0f, (float) (sampleRate * 0.49), frequency);
+    }
+
+    bool isGliding() const
+    {
+        for (auto& s : smoothers)
+            if (s.cutoff.isSmoothing() || s.resonance.isSmoothing() || s.drive.isSmoothing())
+                return true;
+
+        return false;
+    }
+
+    void updateFixedCoefficients()
+    {
+        float cutoff[numCorners], resonance[numCorners], drive[numCorners];
+
+        for (int corner = 0; corner < numCorners; ++corner)
+        {
+            cutoff[corner] = smoothers[corner].cutoff.getCurrentValue();
+            resonance[corner] = smoothers[corner].resonance.getCurrentValue();
+            drive[corner] = smoothers[corner].drive.getCurrentValue();
+        }
+
+        makeCoefficients(cutoff, resonance, drive, fixed);
+    }
+
+    void makeCoefficients(const float* cutoff, const float* resonance, const float* drive, LaneCoefficients& c) const
+    {
+        for (int corner = 0; corner < numCorners; ++corner)
+        {
+            const auto g = (float) std::tan(juce::MathConstants<double>::pi * cutoff[corner] / sampleRate);
+            const auto k = 1.0f / resonance[corner];
+            c.a1[corner] = 1.0f / (1.0f + g * (g + k));
+            c.a2[corner] = g * c.a1[corner];
+            c.a3[corner] = g * c.a2[corner];
+
+            // output = inputMix * v0 + bandPassMix * v1 + lowPassMix * v2
+            switch (modes[corner])
+            {
+                case Mode::lowPass:  c.inputMix[corner] = 0.0f; c.bandPassMix[corner] = 0.0f; c.lowPassMix[corner] = 1.0f;  break;
+                case Mode::highPass: c.inputMix[corner] = 1.0f; c.bandPassMix[corner] = -k;   c.lowPassMix[corner] = -1.0f; break;
+                case Mode::bandPass: c.inputMix[corner] = 0.0f; c.bandPassMix[corner] = 1.0f; c.lowPassMix[corner] = 0.0f;  break;
+                case Mode::notch:    c.inputMix[corner] = 1.0f; c.bandPassMix[corner] = -k;   c.lowPassMix[corner] = 0.0f;  break;
+            }
+
+            c.drive[corner] = drive[corner];
+            c.preGain[corner] = 1.0f + (maxPreGain - 1.0f) * drive[corner];
+        }
+    }
+
+    // Drive then filter, for one instant of all four corners
+    static CornerLanes::Vec tick(CornerLanes::Vec x, const LaneCoefficients& c, CornerLanes::Vec& ic1eq, CornerLanes::Vec& ic2eq) noexcept
+    {
+        using namespace CornerLanes;
+
+        // Pade approximation of tanh, exact enough inside +-3 and flat outside it,
+        // crossfaded with the clean signal by the drive amount
+        const auto limit = set1(3.0f);
+        const auto driven = clamp(mul(x, load(c.preGain)), sub(set1(0.0f), limit), limit);
+        const auto squared = mul(driven, driven);
+        const auto saturated = div(mul(driven, add(set1(27.0f), squared)), add(set1(27.0f), mul(set1(9.0f), squared)));
+        const auto v0 = add(x, mul(load(c.drive), sub(saturated, x)));
+
+        const auto v3 = sub(v0, ic2eq);
+        const auto v1 = add(mul(load(c.a1), ic1eq), mul(load(c.a2), v3));
+        const auto v2 = add(ic2eq, add(mul(load(c.a2), ic1eq), mul(load(c.a3), v3)));
+        ic1eq = sub(add(v1, v1), ic1eq);
+        ic2eq = sub(add(v2, v2), ic2eq);
+
+        return add(mul(load(c.inputMix), v0), add(mul(load(c.bandPassMix), v1), mul(load(c.lowPassMix), v2)));
+    }
+
+    template <typename CoefficientsAt>
+    static void processChannel(float* const* data, int numSamples, ChannelState& s, CoefficientsAt&& coefficientsAt) noexcept
+    {
+        using namespace CornerLanes;
+        auto ic1eq = load(s.ic1eq), ic2eq = load(s.ic2eq);
+        int i = 0;
+
+        // Four samples of each corner in, transposed to four instants of all corners
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            auto r0 = loadUnaligned(data[0] + i), r1 = loadUnaligned(data[1] + i);
+            auto r2 = loadUnaligned(data[2] + i), r3 = loadUnaligned(data[3] + i);
+            transpose(r0, r1, r2, r3);
+
+            r0 = tick(r0, coefficientsAt(i),     ic1eq, ic2eq);
+            r1 = tick(r1, coefficientsAt(i + 1), ic1eq, ic2eq);
+            r2 = tick(r2, coefficientsAt(i + 2), ic1eq, ic2eq);
+            r3 = tick(r3, coefficientsAt(i + 3), ic1eq, ic2eq);
+
+            transpose(r0, r1, r2, r3);
+            storeUnaligned(data[0] + i, r0);
+            storeUnaligned(data[1] + i, r1);
+            storeUnaligned(data[2] + i, r2);
+            storeUnaligned(data[3] + i, r3);
+        }
+
+        for (; i < numSamples; ++i)
+        {
+            alignas(16) float lanes[numCorners] = { data[0][i], data[1][i], data[2][i], data[3][i] };
+            store(lanes, tick(load(lanes), coefficientsAt(i), ic1eq, ic2eq));
+
+            for (int corner = 0; corner < numCorners; ++corner)
+                data[corner][i] = lanes[corner];
+        }
+
+        store(s.ic1eq, ic1eq);
+        store(s.ic2eq, ic2eq);
+
+        // Keep the states from sinking into denormals after the input stops
+        for (int corner = 0; corner < numCorners; ++corner)
+        {
+            if (std::abs(s.ic1eq[corner]) < 1.0e-15f) s.ic1eq[corner] = 0.0f;
+            if (std::abs(s.ic2eq[corner]) < 1.0e-15f) s.ic2eq[corner] = 0.0f;
+        }
+    }
+
+    double sampleRate = 44100.0;
+    int blockSize = 512;
+    Mode modes[numCorners] = { Mode::lowPass, Mode::lowPass, Mode::lowPass, Mode::lowPass };
+    Smoothers smoothers[numCorners];
+    LaneCoefficients fixed {};
+    std::vector<ChannelState> state;         // One per channel, sized in prepare()
+    std::vector<LaneCoefficients> scratch;   // Per-sample coefficients while gliding
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CornerFilterBank)
+};
@@ -0,0 +1,74 @@
+/*
+  ==============================================================================
+
+    CornerMeters.h
+    Created: 15 May 2024 11:04:27am
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include "EngineSnapshot.h"
+
+// What the editor shows on each quadrant for one block: the corner's peak
+// level and how far through its file the newest note is.
+struct CornerMeterFrame
+{
+    float peak[EngineSnapshot::numCorners] = {};
+    float playhead[EngineSnapshot::numCorners] = { -1.0f, -1.0f, -1.0f, -1.0f }; // 0 to 1, negative when not playing
+};
+
+// Carries CornerMeterFrames from the audio thread to the editor. One push per
+// block and one pull per display refresh; neither side ever waits, and the
+// audio thread only copies a frame into a slot that's already there. If the
+// editor isn't pulling, the FIFO fills up and new frames are dropped.
+class CornerMeterFifo
+{
+public:
+    CornerMeterFifo() {}
+
+    // Audio thread only
+    void push(const CornerMeterFrame& frame) noexcept
+    {
+        const auto write = fifo.write(1);
+
+        if (write.blockSize1 > 0)
+            frames[(size_t) write.startIndex1] = frame;
+    }
+
+    // Message thread only. Folds every waiting frame into one, the loudest
+    // peaks and the latest playheads. Returns false if there were none.
+    bool pull(CornerMeterFrame& result) noexcept
+    {
+        const auto read = fifo.read(fifo.getNumReady());
+
+        if (read.blockSize1 + read.blockSize2 == 0)
+            return false;
+
+        result = {};
+
+        read.forEach([this, &result] (int index)
+        {
+            const auto& frame = frames[(size_t) index];
+
+            for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+            {
+                result.peak[c] = juce::jmax(result.peak[c], frame.peak[c]);
+                result.playhead[c] = frame.playhead[c];
+            }
+        });
+
+        return true;
+    }
+
+private:
+    static constexpr int capacity = 64; // Over a second of blocks at 512 samples
+    juce::AbstractFifo fifo { capacity };
+    std::array<CornerMeterFrame, capacity> frames {};
+
+    JUCE_DECLARE_NON_COPYABLE(CornerMeterFifo)
+};
@@ -0,0 +1,207 @@
+/*
+  ==============================================================================
+
+    EngineSnapshot.h
+    Created: 14 Mar 2024 10:12:41am
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "SamplePool.h"
+#include "SamplePlayer.h"
+#include "SpectralMorph.h"
+
+// One voice's cursor into one corner's sample: its own source, so every voice
+// can be at a different place in the file, and a SamplePlayer for the pitch.
+// Retuning is a single atomic rate update; nothing is rebuilt.
+struct CornerPlayer
+{
+    // Lowest and highest playback speed a note can ask for, three octaves either way
+    static constexpr double minSpeed = 0.125, maxSpeed = 8.0;
+
+    // Off the audio thread, or with it stopped
+    void prepare(int samplesPerBlock, double sampleRate, int numChannels)
+    {
+        if (source == nullptr)
+            return;
+
+        deviceSampleRate = sampleRate;
+        source->prepareToPlay(samplesPerBlock, fileSampleRate);
+        player.prepare(source.get(), numChannels, samplesPerBlock, fileSampleRate / deviceSampleRate * maxSpeed);
+    }
+
+    // Audio thread. Rewinds to the start of the sample at the given speed.
+    void restart(double speed)
+    {
+        setSpeed(speed);
+        player.restart();
+    }
+
+    void rewind() { player.restart(); }
+
+    // Any thread
+    void setSpeed(double speed)
+    {
+        player.setRate(fileSampleRate / deviceSampleRate * juce::jlimit(minSpeed, maxSpeed, speed));
+    }
+
+    bool hasReachedEnd() const { return player.hasReachedEnd(); }
+    double getProportionPlayed() const { return player.getProportionPlayed(); }
+
+    std::unique_ptr<juce::PositionableAudioSource> source;
+    SamplePlayer player; // Reads from source
+    double fileSampleRate = 44100.0, deviceSampleRate = 44100.0;
+};
+
+// Everything the audio thread needs to play the four corners. A snapshot is
+// built completely off the audio thread and never modified after publishing,
+// apart from the playback state inside the corner players.
+struct EngineSnapshot
+{
+    static constexpr int numCorners = 4;
+    static constexpr int maxVoices = 16; // Size of the voice pool; the polyphony parameter picks how many are used
+
+    juce::Array<juce::File> files;
+    SampleData::Ptr sample[numCorners]; // Keeps the audio alive while this snapshot plays it
+    CornerPlayer players[maxVoices][numCorners]; // [voice][corner], empty for corners without a sample
+
+    // What brings a corner to the target loudness, unity until it's measured
+    float getNormalizationGain(int corner) const
+    {
+        return sample[corner] != nullptr ? sample[corner]->getNormalizationGain() : 1.0f;
+    }
+
+    // What a corner's grains read from, null until the pool has built it
+    const juce::AudioBuffer<float>* getGrainAudio(int corner) const
+    {
+        return sample[corner] != nullptr ? sample[corner]->getGrainAudio() : nullptr;
+    }
+
+    // A corner's spectral frames, null until the pool has built them
+    const SpectralFrames* getSpectralFrames(int corner) const
+    {
+        return sample[corner] != nullptr ? sample[corner]->getSpectralFrames() : nullptr;
+    }
+};
+
+// Hands snapshots from the loading side to the audio thread without locks.
+//
+// publish() parks a new snapshot in a single atomic slot. The audio thread
+// picks it up at the start of the next block with one exchange. The one it was
+// using drains: voices and grains already playing from it carry on until they
+// end. Once retireUnused() finds nothing left in it, it goes into a small FIFO,
+// which collectGarbage() empties on the message thread. The audio thread
+// therefore never frees memory or waits.
+class EngineSnapshotExchange
+{
+public:
+    EngineSnapshotExchange() {}
+
+    ~EngineSnapshotExchange()
+    {
+        collectGarbage();
+        delete pending.exchange(nullptr);
+        delete live;
+
+        for (int i = 0; i < numDraining; ++i)
+            delete draining[i];
+    }
+
+    // Any non-audio thread. A snapshot that was published but never picked up
+    // is simply replaced, since the audio thread has not seen it yet.
+    void publish(std::unique_ptr<EngineSnapshot> next)
+    {
+        delete pending.exchange(next.release(), std::memory_order_acq_rel);
+    }
+
+    // Audio thread only. Returns the snapshot to use for new notes in this
+    // block, or nullptr if nothing has been loaded yet. With every draining
+    // slot taken, a new snapshot waits until one of them is retired.
+    EngineSnapshot* acquire() noexcept
+    {
+        if (pending.load(std::memory_order_relaxed) != nullptr && numDraining < maxDraining)
+        {
+            if (auto* next = pending.exchange(nullptr, std::memory_order_acq_rel))
+            {
+                if (live != nullptr)
+                    draining[numDraining++] = live;
+
+                live = next;
+            }
+        }
+
+        return live;
+    }
+
+    // Audio thread only. Passes every draining snapshot that isInUse(snapshot)
+    // says nothing plays from any more on to collectGarbage().
+    template <typename Predicate>
+    void retireUnused(Predicate&& isInUse) noexcept
+    {
+        for (int i = 0; i < numDraining;)
+        {
+            if (retiredFifo.getFreeSpace() == 0)
+                return;
+
+            if (isInUse(*draining[i]))
+            {
+                ++i;
+                continue;
+            }
+
+            const auto write = retiredFifo.write(1);
+            retired[(size_t) write.startIndex1] = draining[i];
+            draining[i] = draining[--numDraining];
+        }
+    }
+
+    // Message thread. Deletes the snapshots the audio thread has let go of.
+    void collectGarbage()
+    {
+        const auto read = retiredFifo.read(retiredFifo.getNumReady());
+
+        read.forEach([this] (int index)
+        {
+            delete retired[(size_t) index];
+            retired[(size_t) index] = nullptr;
+        });
+    }
+
+    // Only while the audio thread is stopped, e.g. from prepareToPlay().
+    template <typename Function>
+    void forEachPrepared(Function&& function)
+    {
+        if (live != nullptr)
+            function(*live);
+
+        if (auto* waiting = pending.exchange(nullptr, std::memory_order_acq_rel))
+        {
+            function(*waiting);
+
+            EngineSnapshot* expected = nullptr;
+            if (! pending.compare_exchange_strong(expected, waiting))
+                delete waiting; // A newer one arrived while we were preparing
+        }
+    }
+
+private:
+    std::atomic<EngineSnapshot*> pending { nullptr };
+    EngineSnapshot* live = nullptr;
+
+    // Replaced but still playing, audio thread only
+    static constexpr int maxDraining = 8;
+    std::array<EngineSnapshot*, maxDraining> draining {};
+    int numDraining = 0;
+
+    static constexpr int retiredCapacity = 16;
+    juce::AbstractFifo retiredFifo { retiredCapacity };
+    std::array<EngineSnapshot*, retiredCapacity> retired {};
+
+    JUCE_DECLARE_NON_COPYABLE(EngineSnapshotExchange)
+};
@@ -11,51 +11,150 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <cmath>
+#include <vector>
 
+// A topology-preserving-transform state-variable filter (the trapezoidal SVF
+// from Zavalishin and Simper) with low-pass, high-pass, band-pass and notch
+// outputs. Every channel keeps its own two integrator states.
+//
+// Cutoff and resonance glide to their targets. While they move, the
+// coefficients are worked out per sample into scratch arrays sized in
+// prepare(), so modulating them never touches the heap; once they settle
+// the filter runs on one fixed set.
 class LowPassFilterEffect
 {
 public:
+    enum class Mode { lowPass, highPass, bandPass, notch };
+
     LowPassFilterEffect() {}
     ~LowPassFilterEffect() {}
 
     void prepare(const juce::dsp::ProcessSpec& spec)
     {
-        lowPassFilter.reset(new juce::dsp::IIR::Filter<float>());
-
-        auto coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass(spec.sampleRate, 20000.0f);
-        lowPassFilter->coefficients = coefficients;
+        lastSampleRate = spec.sampleRate;
+        maxBlockSize = juce::jmax(1, (int) spec.maximumBlockSize);
 
-        lowPassFilter->prepare(spec);
+        state.assign(spec.numChannels, {});
+        scratch.assign((size_t) maxBlockSize, {});
 
-        lastSampleRate = spec.sampleRate;
+        cutoff.reset(lastSampleRate, smoothingSeconds);
+        resonance.reset(lastSampleRate, smoothingSeconds);
+        cutoff.setCurrentAndTargetValue(limitCutoff(cutoff.getTargetValue()));
+        resonance.setCurrentAndTargetValue(resonance.getTargetValue());
+        fixed = makeCoefficients(cutoff.getCurrentValue(), resonance.getCurrentValue());
     }
 
-
     void reset()
     {
-        lowPassFilter->reset();
+        std::fill(state.begin(), state.end(), ChannelState {});
     }
 
     void process(juce::AudioBuffer<float>& buffer)
     {
-        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        process(buffer, 0, buffer.getNumSamples());
+    }
+
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        jassert(! scratch.empty()); // prepare() hasn't been called
+        const int numChannels = juce::jmin(buffer.getNumChannels(), (int) state.size());
+
+        for (int done = 0; done < numSamples;)
         {
-            juce::dsp::AudioBlock<float> block(buffer);
-            auto singleChannelBlock = block.getSingleChannelBlock(channel);
-            juce::dsp::ProcessContextReplacing<float> context(singleChannelBlock);
-            lowPassFilter->process(context);
+            const int num = juce::jmin(numSamples - done, maxBlockSize);
+            const bool smoothing = cutoff.isSmoothing() || resonance.isSmoothing();
+
+            if (smoothing)
+            {
+                for (int i = 0; i < num; ++i)
+                    scratch[(size_t) i] = makeCoefficients(cutoff.getNextValue(), resonance.getNextValue());
+
+                fixed = scratch[(size_t) num - 1];
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto* data = buffer.getWritePointer(channel, startSample + done);
+
+                if (smoothing)
+                    processChannel(data, num, state[(size_t) channel], [this] (int i) -> const Coefficients& { return scratch[(size_t) i]; });
+                else
+                    processChannel(data, num, state[(size_t) channel], [this] (int) -> const Coefficients& { return fixed; });
+            }
+
+            done += num;
         }
     }
-    
+
+    // Cutoff in Hz and resonance as Q. Only sets targets, so it is cheap
+    // enough to call for every sub-block on the audio thread.
     void updateParameters(float frequency, float qualityFactor)
     {
-        // Update the low pass filter coefficients
-        auto coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass(lastSampleRate, frequency, qualityFactor);
-        lowPassFilter->coefficients = *coefficients; // Assign the new coefficients
+        cutoff.setTargetValue(limitCutoff(frequency));
+        resonance.setTargetValue(juce::jlimit(0.05f, 40.0f, qualityFactor));
     }
 
+    void setMode(Mode newMode) { mode = newMode; }
+    Mode getMode() const { return mode; }
+
 private:
-    std::unique_ptr<juce::dsp::IIR::Filter<float>> lowPassFilter;
+    struct Coefficients { float a1 = 1.0f, a2 = 0.0f, a3 = 0.0f, k = 1.0f; };
+    struct ChannelState { float ic1eq = 0.0f, ic2eq = 0.0f; };
+
+    static constexpr double smoothingSeconds = 0.02;
+
+    float limitCutoff(float frequency) const
+    {
+        return juce::jlimit(10.0f, (float) (lastSampleRate * 0.49), frequency);
+    }
+
+    Coefficients makeCoefficients(float frequency, float qualityFactor) const
+    {
+        Coefficients c;
+        const auto g = (float) std::tan(juce::MathConstants<double>::pi * frequency / lastSampleRate);
+        c.k = 1.0f / qualityFactor;
+        c.a1 = 1.0f / (1.0f + g * (g + c.k));
+        c.a2 = g * c.a1;
+        c.a3 = g * c.a2;
+        return c;
+    }
+
+    template <typename CoefficientsAt>
+    void processChannel(float* data, int numSamples, ChannelState& s, CoefficientsAt&& coefficientsAt) const noexcept
+    {
+        float ic1eq = s.ic1eq, ic2eq = s.ic2eq;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto& c = coefficientsAt(i);
+            const float v0 = data[i];
+            const float v3 = v0 - ic2eq;
+            const float v1 = c.a1 * ic1eq + c.a2 * v3; // Band-pass
+            const float v2 = ic2eq + c.a2 * ic1eq + c.a3 * v3; // Low-pass
+            ic1eq = 2.0f * v1 - ic1eq;
+            ic2eq = 2.0f * v2 - ic2eq;
+
+            switch (mode)
+            {
+                case Mode::lowPass:  data[i] = v2; break;
+                case Mode::highPass: data[i] = v0 - c.k * v1 - v2; break;
+                case Mode::bandPass: data[i] = v1; break;
+                case Mode::notch:    data[i] = v0 - c.k * v1; break;
+            }
+        }
+
+        // Keep the states from sinking into denormals after the input stops
+        s.ic1eq = std::abs(ic1eq) < 1.0e-15f ? 0.0f : ic1eq;
+        s.ic2eq = std::abs(ic2eq) < 1.0e-15f ? 0.0f : ic2eq;
+    }
+
+    Mode mode = Mode::lowPass;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> cutoff { 20000.0f };
+    juce::SmoothedValue<float> resonance { 0.7071f };
+    Coefficients fixed;
+    std::vector<ChannelState> state;       // One per channel, sized in prepare()
+    std::vector<Coefficients> scratch;     // Per-sample coefficients while gliding
+    int maxBlockSize = 512;
     double lastSampleRate = 44100.0; // Default to standard CD sample rate
 };
-
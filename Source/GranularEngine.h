@@ -0,0 +1,302 @@
+/*
+  ==============================================================================
+
+    GranularEngine.h
+    Created: 6 May 2024 8:14:03pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+#include "EngineSnapshot.h"
+
+// Granular playback of the four corners. Every sounding voice has a Stream
+// that fires grains at the density, each one taken from a corner picked at
+// random with the XY pad's weights, from around the stream's playhead in that
+// corner's sample.
+//
+// Grains come from a fixed pool and are never allocated. The window is one
+// precomputed Hann table that every grain steps through at its own rate.
+// Rendering a grain is a gather with linear interpolation from the sample;
+// the window, the gain and the sum into the output are vector operations.
+// The cost per grain is fixed, so CPU follows the number of active grains,
+// and the pool size caps that.
+class GranularEngine
+{
+public:
+    static constexpr int maxGrains = 2048;
+
+    struct Settings
+    {
+        float density = 40.0f; // Grains per second, per voice
+        float sizeMs = 80.0f;
+        float jitter = 0.2f;   // How far grains scatter in time and in the sample, 0 to 1
+        float spread = 0.5f;   // How far grains scatter across the stereo field, 0 to 1
+        const float* cornerGains = nullptr; // Level of each corner's grains, or null for unity
+    };
+
+    // Where one voice is in the grain cloud
+    struct Stream
+    {
+        double position = 0.0;           // Playhead, in seconds into the samples
+        double samplesToNextGrain = 0.0;
+
+        void reset() { position = 0.0; samplesToNextGrain = 0.0; }
+    };
+
+    GranularEngine() { reset(); }
+
+    // Allocates. Call before rendering, off the audio thread.
+    void prepare(double sampleRate, int maxBlockSize, int numChannels)
+    {
+        deviceSampleRate = sampleRate;
+        windowScratch.assign((size_t) juce::jmax(1, maxBlockSize), 0.0f);
+        sourceScratch.assign((size_t) juce::jmax(1, maxBlockSize), 0.0f);
+        outputChannels = juce::jmax(1, numChannels);
+        getWindow(); // Builds the table here rather than on the audio thread
+        reset();
+    }
+
+    // Drops every grain
+    void reset()
+    {
+        numActive = 0;
+        numFree = maxGrains;
+
+        for (int i = 0; i < maxGrains; ++i)
+            freeList[i] = maxGrains - 1 - i;
+    }
+
+    // Starts the grains that fall due in the next numSamples for one stream.
+    // envelope holds the voice's level for each of those samples and
+    // cornerWeights the XY pad's weights. blockOffset is where this stretch
+    // starts within what the next render() call covers.
+    void schedule(const EngineSnapshot& engine, Stream& stream, int blockOffset, int numSamples, double speed,
+                  const float* envelope, const float* cornerWeights, const Settings& settings)
+    {
+        const double interval = deviceSampleRate / juce::jmax(0.1f, settings.density);
+        const double grainSeconds = settings.sizeMs / 1000.0;
+
+        // Roughly constant loudness however much the grains overlap
+        const float overlapGain = 1.0f / std::sqrt(juce::jmax(1.0f, (float) (settings.density * grainSeconds)));
+
+        while (stream.samplesToNextGrain < numSamples)
+        {
+            const int offset = juce::jmax(0, (int) stream.samplesToNextGrain);
+            startGrain(engine, stream, blockOffset + offset, speed, envelope[offset] * overlapGain, cornerWeights, settings);
+
+            const auto scatter = 1.0 + settings.jitter * (random.nextDouble() - 0.5);
+            stream.samplesToNextGrain += juce::jmax(1.0, interval * scatter);
+        }
+
+        stream.samplesToNextGrain -= numSamples;
+        stream.position += numSamples / deviceSampleRate * speed;
+    }
+
+    // Adds every active grain into the buffer over the range
+    void render(juce::AudioBuffer<float>& output, int startSample, int numSamples)
+    {
+        const auto& window = getWindow();
+        const int numOutputChannels = juce::jmin(output.getNumChannels(), outputChannels);
+
+        for (int index = 0; index < numActive;)
+        {
+            auto& grain = grains[active[index]];
+
+            for (int done = grain.delay; done < numSamples;)
+            {
+                const int num = juce::jmin(numSamples - done, (int) windowScratch.size(),
+                                           (int) std::ceil((windowSize - grain.windowPhase) / grain.windowIncrement));
+
+                if (num <= 0)
+                    break;
+
+                fillWindow(grain, window, num);
+
+                int lastSourceChannel = -1;
+
+                for (int channel = 0; channel < numOutputChannels; ++channel)
+                {
+                    // Mono sources feed every output channel, so only read them once
+                    const int sourceChannel = channel % grain.audio->getNumChannels();
+
+                    if (sourceChannel != lastSourceChannel)
+                    {
+                        readSource(grain, sourceChannel, num);
+                        juce::FloatVectorOperations::multiply(sourceScratch.data(), windowScratch.data(), num);
+                        lastSourceChannel = sourceChannel;
+                    }
+
+                    juce::FloatVectorOperations::addWithMultiply(output.getWritePointer(channel, startSample + done),
+                                                                 sourceScratch.data(), grain.gain[juce::jmin(channel, 1)], num);
+                }
+
+                grain.position = std::fmod(grain.position + num * grain.increment, (double) (grain.audio->getNumSamples() - 1));
+                grain.windowPhase += num * grain.windowIncrement;
+                done += num;
+            }
+
+            grain.delay = 0;
+
+            if (grain.windowPhase >= windowSize)
+            {
+                // Finished: swap the last active grain into this slot
+                freeList[numFree++] = active[index];
+                active[index] = active[--numActive];
+            }
+            else
+            {
+                ++index;
+            }
+        }
+    }
+
+    int getNumActiveGrains() const { return numActive; }
+
+    // True while any grain still reads from the snapshot
+    bool isUsing(const EngineSnapshot& engine) const
+    {
+        for (int index = 0; index < numActive; ++index)
+            if (grains[active[index]].engine == &engine)
+                return true;
+
+        return false;
+    }
+
+private:
+    static constexpr int windowSize = 1024;
+    static constexpr double maxJitterSeconds = 0.5;
+
+    struct Grain
+    {
+        const EngineSnapshot* engine = nullptr; // Where audio comes from; not freed while the grain plays
+        const juce::AudioBuffer<float>* audio = nullptr;
+        double position = 0.0;        // In source frames
+        double increment = 1.0;       // Source frames per output sample
+        double windowPhase = 0.0;     // Position in the window table
+        double windowIncrement = 1.0;
+        float gain[2] = {};           // Left and right
+        int delay = 0;                // Samples into the next render before it starts
+    };
+
+    // Hann, with a guard point so interpolation never reads past the end
+    static const std::vector<float>& getWindow()
+    {
+        static const std::vector<float> window = []
+        {
+            std::vector<float> table((size_t) windowSize + 1);
+
+            for (int i = 0; i <= windowSize; ++i)
+                table[(size_t) i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float) i / (float) windowSize);
+
+            return table;
+        }();
+
+        return window;
+    }
+
+    void startGrain(const EngineSnapshot& engine, const Stream& stream, int delay, double speed,
+                    float level, const float* cornerWeights, const Settings& settings)
+    {
+        if (numFree == 0)
+            return; // Pool is full; this grain is skipped rather than stealing one
+
+        // Pick a corner with the pad's weights, among those that have audio
+        float weights[EngineSnapshot::numCorners];
+        float total = 0.0f;
+
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+        {
+            const auto* audio = engine.getGrainAudio(c);
+            weights[c] = audio != nullptr && audio->getNumSamples() > 1 ? cornerWeights[c] : 0.0f;
+            total += weights[c];
+        }
+
+        if (total <= 0.0f)
+            return;
+
+        int corner = 0;
+        for (float pick = random.nextFloat() * total; corner < EngineSnapshot::numCorners - 1; ++corner)
+        {
+            pick -= weights[corner];
+            if (pick < 0.0f && weights[corner] > 0.0f)
+                break;
+        }
+
+        if (weights[corner] <= 0.0f)
+            return;
+
+        const auto* audio = engine.getGrainAudio(corner);
+        const double fileRate = engine.sample[corner] != nullptr ? engine.sample[corner]->sampleRate : deviceSampleRate;
+        const double length = audio->getNumSamples() - 1;
+        const double scatter = settings.jitter * maxJitterSeconds * (2.0 * random.nextDouble() - 1.0);
+        const double start = std::fmod((stream.position + scatter) * fileRate, length);
+
+        if (settings.cornerGains != nullptr)
+            level *= settings.cornerGains[corner];
+
+        auto& grain = grains[freeList[--numFree]];
+        active[numActive++] = (int) (&grain - grains);
+
+        grain.engine = &engine;
+        grain.audio = audio;
+        grain.position = start < 0.0 ? start + length : start;
+        grain.increment = fileRate / deviceSampleRate * juce::jlimit(CornerPlayer::minSpeed, CornerPlayer::maxSpeed, speed);
+        grain.windowPhase = 0.0;
+        grain.windowIncrement = windowSize / juce::jmax(1.0, settings.sizeMs / 1000.0 * deviceSampleRate);
+        grain.delay = delay;
+
+        // Equal-power pan around the centre
+        const auto pan = 0.5f + settings.spread * (random.nextFloat() - 0.5f);
+        const auto angle = pan * juce::MathConstants<float>::halfPi;
+        const bool stereo = outputChannels > 1;
+        grain.gain[0] = level * (stereo ? std::cos(angle) : 1.0f);
+        grain.gain[1] = level * (stereo ? std::sin(angle) : 1.0f);
+    }
+
+    void fillWindow(const Grain& grain, const std::vector<float>& window, int num)
+    {
+        auto phase = grain.windowPhase;
+
+        for (int i = 0; i < num; ++i, phase += grain.windowIncrement)
+        {
+            const auto index = juce::jmin(windowSize - 1, (int) phase);
+            const auto frac = (float) (phase - index);
+            windowScratch[(size_t) i] = window[(size_t) index] + frac * (window[(size_t) index + 1] - window[(size_t) index]);
+        }
+    }
+
+    // The grain's next num frames of one channel, wrapping at the end of the sample
+    void readSource(const Grain& grain, int channel, int num)
+    {
+        const auto* data = grain.audio->getReadPointer(channel);
+        const int length = grain.audio->getNumSamples();
+        auto position = grain.position;
+
+        for (int i = 0; i < num; ++i, position += grain.increment)
+        {
+            while (position >= length - 1)
+                position -= length - 1;
+
+            const auto index = (int) position;
+            const auto frac = (float) (position - index);
+            sourceScratch[(size_t) i] = data[index] + frac * (data[index + 1] - data[index]);
+        }
+    }
+
+    double deviceSampleRate = 44100.0;
+    int outputChannels = 2;
+    Grain grains[maxGrains];
+    int active[maxGrains] = {};   // Indices of sounding grains, in no particular order
+    int freeList[maxGrains] = {}; // Indices of idle grains, used as a stack
+    int numActive = 0, numFree = maxGrains;
+    std::vector<float> windowScratch, sourceScratch;
+    juce::Random random;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GranularEngine)
+};
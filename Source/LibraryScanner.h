@@ -0,0 +1,358 @@
+/*
+  ==============================================================================
+
+    LibraryScanner.h
+    Created: 13 May 2024 10:21:53am
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+
+// Finds every file the format manager can read under a folder, subfolders
+// included, on its own thread. Files are handed to onFilesFound in batches on
+// the message thread as the scan goes, so the first ones can play long before
+// a big library is done.
+//
+// The list for each folder is kept in a small compressed index, and opening
+// the same folder again serves that instead of waiting for a walk of the disk.
+// The index records every folder it went into along with that folder's
+// modification time. Folders that have gone, and files that have gone, are left
+// out. Any folder whose time has moved on is listed again straight afterwards,
+// along with any subfolders that are new in it, and only the new files are
+// handed over. scan() with forceRescan skips the index altogether.
+class LibraryScanner : private juce::Thread,
+                       private juce::AsyncUpdater
+{
+public:
+    explicit LibraryScanner(juce::AudioFormatManager& manager)
+        : juce::Thread("Specter library scanner"), formatManager(manager) {}
+
+    ~LibraryScanner() override
+    {
+        stopThread(5000);
+        cancelPendingUpdate();
+    }
+
+    // Both called on the message thread
+    std::function<void(const juce::Array<juce::File>&)> onFilesFound;
+    std::function<void(int numFiles, bool fromIndex)> onScanFinished;
+
+    // Message thread. Drops whatever scan is running and starts on folder.
+    void scan(const juce::File& folder, bool forceRescan = false)
+    {
+        stopThread(5000);
+        cancelPendingUpdate();
+
+        {
+            const juce::ScopedLock sl(pendingLock);
+            pending.clearQuick();
+            finished = false;
+        }
+
+        root = folder;
+        rescan = forceRescan;
+        wildcard = formatManager.getWildcardForAllFormats();
+        numFound = 0;
+        startThread(juce::Thread::Priority::low);
+    }
+
+    bool isScanning() const { return isThreadRunning(); }
+    int getNumFilesFound() const { return numFound.load(); }
+
+    static juce::File getIndexFile(const juce::File& folder)
+    {
+        return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                   .getChildFile("Specter").getChildFile("Libraries")
+                   .getChildFile(juce::String::toHexString(folder.getFullPathName().hashCode64()) + ".index");
+    }
+
+private:
+    static constexpr int batchSize = 256;
+    static constexpr int indexVersion = 3;
+
+    struct Folder
+    {
+        juce::File directory;
+        juce::int64 modified = 0;      // Milliseconds, when it was last listed
+        juce::Array<juce::File> files; // Only the ones directly inside it
+    };
+
+    void run() override
+    {
+        juce::Array<Folder> folders;
+        const bool fromIndex = ! rescan && readIndex(folders);
+        bool changed = ! fromIndex;
+        juce::HashMap<juce::String, bool> known; // Every folder listed, so none is listed twice
+        juce::Array<int> stale;
+        lastDelivery = juce::Time::getMillisecondCounter();
+
+        if (fromIndex)
+        {
+            for (int i = folders.size(); --i >= 0;)
+            {
+                if (! folders.getReference(i).directory.isDirectory())
+                {
+                    folders.remove(i);
+                    changed = true;
+                }
+            }
+
+            for (int i = 0; i < folders.size() && ! threadShouldExit(); ++i)
+            {
+                auto& folder = folders.getReference(i);
+                known.set(getKey(folder.directory), true);
+
+                if (folder.directory.getLastModificationTime().toMilliseconds() != folder.modified)
+                    stale.add(i);
+
+                for (int j = folder.files.size(); --j >= 0;)
+                {
+                    if (! folder.files.getReference(j).existsAsFile())
+                    {
+                        folder.files.remove(j);
+                        changed = true;
+                    }
+                }
+
+                for (const auto& file : folder.files)
+                    found(file);
+            }
+
+            flushFound();
+        }
+        else
+        {
+            folders.add({ root, 0, {} });
+            known.set(getKey(root), true);
+            stale.add(0);
+        }
+
+        for (auto index : stale)
+            if (! list(folders, index, known))
+                return;
+
+        flushFound();
+
+        if (threadShouldExit())
+            return;
+
+        changed = changed || ! stale.isEmpty();
+
+        if (changed)
+            writeIndex(folders);
+
+        {
+            const juce::ScopedLock sl(pendingLock);
+            finished = true;
+            finishedFromIndex = fromIndex && ! changed;
+        }
+
+        triggerAsyncUpdate();
+    }
+
+    // Lists the files directly inside folders[index], handing over any it didn't
+    // already have, then lists any subfolder not seen before the same way, all
+    // the way down. False if the scan was abandoned.
+    bool list(juce::Array<Folder>& folders, int index, juce::HashMap<juce::String, bool>& known)
+    {
+        const auto directory = folders.getReference(index).directory;
+        juce::HashMap<juce::String, bool> listed;
+
+        for (const auto& file : folders.getReference(index).files)
+            listed.set(file.getFullPathName(), true);
+
+        // Taken first, so anything added while listing makes the next scan look again
+        const auto modified = directory.getLastModificationTime().toMilliseconds();
+        juce::Array<juce::File> files, subdirectories;
+
+        for (const auto& entry : juce::RangedDirectoryIterator(directory, false, wildcard, juce::File::findFiles))
+        {
+            if (threadShouldExit())
+                return false;
+
+            files.add(entry.getFile());
+
+            if (! listed.contains(entry.getFile().getFullPathName()))
+                found(entry.getFile());
+        }
+
+        for (const auto& entry : juce::RangedDirectoryIterator(directory, false, "*", juce::File::findDirectories))
+            subdirectories.add(entry.getFile());
+
+        auto& folder = folders.getReference(index);
+        folder.modified = modified;
+        folder.files.swapWith(files);
+
+        for (const auto& subdirectory : subdirectories)
+        {
+            // Folders already in the index are listed again only if they changed
+            const auto key = getKey(subdirectory);
+
+            if (known.contains(key))
+                continue;
+
+            known.set(key, true);
+            folders.add({ subdirectory, 0, {} });
+
+            if (! list(folders, folders.size() - 1, known))
+                return false;
+        }
+
+        return true;
+    }
+
+    // A link is known by where it points, so links back up the tree aren't followed round
+    static juce::String getKey(const juce::File& directory)
+    {
+        return (directory.isSymbolicLink() ? directory.getLinkedTarget() : directory).getFullPathName();
+    }
+
+    // Thread only. Hands files over in batches, often enough that the first
+    // ones show up straight away.
+    void found(const juce::File& file)
+    {
+        batch.add(file);
+
+        if (batch.size() >= batchSize || juce::Time::getMillisecondCounter() - lastDelivery > 100)
+            flushFound();
+    }
+
+    void flushFound()
+    {
+        deliver(batch);
+        batch.clearQuick();
+        lastDelivery = juce::Time::getMillisecondCounter();
+    }
+
+    void deliver(const juce::Array<juce::File>& batch)
+    {
+        if (batch.isEmpty())
+            return;
+
+        numFound += batch.size();
+
+        {
+            const juce::ScopedLock sl(pendingLock);
+            pending.addArray(batch);
+        }
+
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        juce::Array<juce::File> batch;
+        bool done = false, doneFromIndex = false;
+
+        {
+            const juce::ScopedLock sl(pendingLock);
+            batch.swapWith(pending);
+            std::swap(done, finished);
+            doneFromIndex = finishedFromIndex;
+        }
+
+        if (! batch.isEmpty() && onFilesFound != nullptr)
+            onFilesFound(batch);
+
+        if (done && onScanFinished != nullptr)
+            onScanFinished(numFound.load(), doneFromIndex);
+    }
+
+    //==============================================================================
+    // A header, then each folder as a line starting with '/', which no file
+    // name can, holding its modification time and its path relative to the
+    // root. The names of the files directly inside it follow, one per line.
+    // All gzipped. An index written for other formats doesn't count, since it
+    // may be missing files.
+    bool readIndex(juce::Array<Folder>& folders) const
+    {
+        const auto indexFile = getIndexFile(root);
+
+        if (! indexFile.existsAsFile())
+            return false;
+
+        juce::FileInputStream fileStream(indexFile);
+
+        if (! fileStream.openedOk())
+            return false;
+
+        juce::GZIPDecompressorInputStream stream(fileStream);
+
+        if (stream.readNextLine() != "SpecterLibrary " + juce::String(indexVersion)
+             || stream.readNextLine() != root.getFullPathName()
+             || stream.readNextLine() != wildcard)
+            return false;
+
+        while (! stream.isExhausted() && ! threadShouldExit())
+        {
+            const auto line = stream.readNextLine();
+
+            if (line.isEmpty())
+                continue;
+
+            if (line.startsWithChar('/'))
+            {
+                folders.add({ root.getChildFile(line.fromFirstOccurrenceOf(" ", false, false)),
+                              line.substring(1).getLargeIntValue(), {} });
+            }
+            else
+            {
+                if (folders.isEmpty())
+                    return false;
+
+                auto& folder = folders.getReference(folders.size() - 1);
+                folder.files.add(folder.directory.getChildFile(line));
+            }
+        }
+
+        return true;
+    }
+
+    void writeIndex(const juce::Array<Folder>& folders) const
+    {
+        const auto indexFile = getIndexFile(root);
+        indexFile.getParentDirectory().createDirectory();
+        juce::TemporaryFile temp(indexFile);
+
+        {
+            juce::FileOutputStream fileStream(temp.getFile());
+
+            if (! fileStream.openedOk())
+                return;
+
+            juce::GZIPCompressorOutputStream stream(fileStream);
+            stream << "SpecterLibrary " << indexVersion << "\n" << root.getFullPathName() << "\n" << wildcard << "\n";
+
+            for (const auto& folder : folders)
+            {
+                stream << "/" << juce::String(folder.modified) << " "
+                       << (folder.directory == root ? juce::String() : folder.directory.getRelativePathFrom(root)) << "\n";
+
+                for (const auto& file : folder.files)
+                    stream << file.getFileName() << "\n";
+            }
+        }
+
+        temp.overwriteTargetFileWithTemporary();
+    }
+
+    juce::AudioFormatManager& formatManager;
+    juce::File root;           // Only changed while the thread is stopped
+    juce::String wildcard;
+    bool rescan = false;
+    std::atomic<int> numFound { 0 };
+    juce::Array<juce::File> batch; // Thread only
+    juce::uint32 lastDelivery = 0;
+
+    juce::CriticalSection pendingLock;
+    juce::Array<juce::File> pending; // Found but not handed over yet
+    bool finished = false, finishedFromIndex = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibraryScanner)
+};
@@ -0,0 +1,162 @@
+/*
+  ==============================================================================
+
+    MappedSample.h
+    Created: 2 Apr 2024 11:03:27am
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "SampleData.h"
+
+// A WAV/AIFF file played straight out of the OS page cache through a
+// MemoryMappedAudioFormatReader. Only the sample frames are mapped, never the
+// header or other chunks. Nothing is copied into our heap, and every plugin
+// instance (or other process) mapping the same file shares the same pages.
+class MappedSample : public SampleData
+{
+public:
+    // Returns nullptr if the format can't be memory-mapped (compressed files,
+    // unusual bit depths ...); the caller should decode those instead.
+    static Ptr create(juce::AudioFormatManager& formatManager, const juce::File& file, juce::Time modified)
+    {
+        auto* format = formatManager.findFormatForFileExtension(file.getFileExtension());
+
+        if (format == nullptr)
+            return nullptr;
+
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader(format->createMemoryMappedReader(file));
+
+        if (reader == nullptr || reader->lengthInSamples <= 0
+             || ! reader->mapSectionOfFile({ 0, reader->lengthInSamples }))
+            return nullptr;
+
+        juce::ReferenceCountedObjectPtr<MappedSample> sample = new MappedSample(file, modified, std::move(reader));
+
+        // Fault in the start now, so the first note doesn't wait on the disk
+        sample->touch(0, (juce::int64) (sample->sampleRate * headSeconds));
+        return sample.get();
+    }
+
+    size_t getSizeInBytes() const override
+    {
+        return 0; // Lives in the page cache, not in our heap
+    }
+
+    std::unique_ptr<juce::PositionableAudioSource> createSource(PlaybackContext& context) override;
+
+    juce::int64 getLengthInSamples() const { return reader->lengthInSamples; }
+
+    // Reads one byte per page in the given range so the OS pulls it in ahead
+    // of the audio thread. Safe to call while the audio thread is reading.
+    void touch(juce::int64 startSample, juce::int64 numSamples) const
+    {
+        const auto end = juce::jmin(startSample + numSamples, reader->lengthInSamples);
+
+        for (auto sample = juce::jmax((juce::int64) 0, startSample); sample < end; sample += framesPerPage)
+            reader->touchSample(sample);
+    }
+
+    // Audio thread. Plain copies and conversion out of mapped memory, no syscalls.
+    void read(juce::AudioBuffer<float>& dest, int destStart, juce::int64 startSample, int numSamples) const
+    {
+        reader->read(&dest, destStart, numSamples, startSample, true, true);
+    }
+
+    static constexpr double headSeconds = 0.5;
+
+private:
+    MappedSample(const juce::File& f, juce::Time modified, std::unique_ptr<juce::MemoryMappedAudioFormatReader> r)
+        : SampleData(f, modified, r->sampleRate),
+          reader(std::move(r)),
+          framesPerPage(juce::jmax((juce::int64) 1,
+                                   (juce::int64) (pageSize / juce::jmax(1u, reader->numChannels * reader->bitsPerSample / 8))))
+    {
+    }
+
+    static constexpr int pageSize = 4096;
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader;
+    const juce::int64 framesPerPage;
+};
+
+// Plays a MappedSample and keeps the pages just ahead of the play position
+// resident, using a shared background thread.
+class MappedSampleSource : public juce::PositionableAudioSource,
+                           private juce::TimeSliceClient
+{
+public:
+    MappedSampleSource(juce::ReferenceCountedObjectPtr<MappedSample> s, juce::TimeSliceThread& thread)
+        : sample(std::move(s)), readAheadThread(thread),
+          lookAheadSamples((juce::int64) (sample->sampleRate * lookAheadSeconds))
+    {
+        readAheadThread.addTimeSliceClient(this);
+    }
+
+    ~MappedSampleSource() override
+    {
+        readAheadThread.removeTimeSliceClient(this);
+    }
+
+    void prepareToPlay(int, double) override {}
+    void releaseResources() override {}
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+    {
+        const auto position = nextReadPosition.load();
+        const auto numAvailable = (int) juce::jlimit((juce::int64) 0, (juce::int64) info.numSamples,
+                                                     sample->getLengthInSamples() - position);
+
+        if (numAvailable > 0)
+            sample->read(*info.buffer, info.startSample, position, numAvailable);
+
+        for (int channel = 0; channel < info.buffer->getNumChannels(); ++channel)
+            info.buffer->clear(channel, info.startSample + numAvailable, info.numSamples - numAvailable);
+
+        nextReadPosition.store(position + info.numSamples);
+    }
+
+    void setNextReadPosition(juce::int64 newPosition) override { nextReadPosition.store(newPosition); }
+    juce::int64 getNextReadPosition() const override           { return nextReadPosition.load(); }
+    juce::int64 getTotalLength() const override                { return sample->getLengthInSamples(); }
+    bool isLooping() const override                            { return false; }
+
+private:
+    int useTimeSlice() override
+    {
+        const auto position = nextReadPosition.load();
+
+        if (position < touchedFrom || position > touchedUpTo)
+            touchedFrom = touchedUpTo = position; // Jumped, e.g. a note restarted the sample
+
+        const auto target = position + lookAheadSamples;
+
+        if (touchedUpTo < target)
+        {
+            sample->touch(touchedUpTo, target - touchedUpTo);
+            touchedUpTo = target;
+        }
+
+        return 20;
+    }
+
+    static constexpr double lookAheadSeconds = 1.0;
+
+    juce::ReferenceCountedObjectPtr<MappedSample> sample;
+    juce::TimeSliceThread& readAheadThread;
+    const juce::int64 lookAheadSamples;
+    std::atomic<juce::int64> nextReadPosition { 0 };
+    juce::int64 touchedFrom = 0, touchedUpTo = 0; // Read-ahead thread only
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MappedSampleSource)
+};
+
+inline std::unique_ptr<juce::PositionableAudioSource> MappedSample::createSource(PlaybackContext& context)
+{
+    return std::make_unique<MappedSampleSource>(this, context.readAheadThread);
+}
@@ -0,0 +1,232 @@
+/*
+  ==============================================================================
+
+    MixKernel.h
+    Created: 23 Apr 2024 8:40:15pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+// The bilinear four-corner mix in one pass over memory:
+//
+//     out[n] += w0 * c0[n] + w1 * c1[n] + w2 * c2[n] + w3 * c3[n]
+//
+// Uses unaligned vector loads (AVX, SSE or NEON, whichever the build targets),
+// so it works on any sub-range of an AudioBuffer. The scalar version is the
+// fallback and the reference the vector paths are checked against. The ramped
+// variants move the weights linearly across the range, which is how the XY
+// pad is smoothed without zipper noise.
+namespace BilinearMix
+{
+    static constexpr int numCorners = 4;
+
+    inline void addScalar(float* out, const float* const* corners, const float* weights, int numSamples, int start = 0) noexcept
+    {
+        const float w0 = weights[0], w1 = weights[1], w2 = weights[2], w3 = weights[3];
+        const float* c0 = corners[0];
+        const float* c1 = corners[1];
+        const float* c2 = corners[2];
+        const float* c3 = corners[3];
+
+        for (int i = start; i < numSamples; ++i)
+            out[i] += w0 * c0[i] + w1 * c1[i] + w2 * c2[i] + w3 * c3[i];
+    }
+
+    inline void addVectorised(float* out, const float* const* corners, const float* weights, int numSamples) noexcept
+    {
+        int i = 0;
+        const float* c0 = corners[0];
+        const float* c1 = corners[1];
+        const float* c2 = corners[2];
+        const float* c3 = corners[3];
+
+       #if JUCE_USE_SSE_INTRINSICS && defined (__AVX__)
+        const auto w0 = _mm256_set1_ps(weights[0]), w1 = _mm256_set1_ps(weights[1]);
+        const auto w2 = _mm256_set1_ps(weights[2]), w3 = _mm256_set1_ps(weights[3]);
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            auto sum = _mm256_add_ps(_mm256_mul_ps(w0, _mm256_loadu_ps(c0 + i)), _mm256_mul_ps(w1, _mm256_loadu_ps(c1 + i)));
+            sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_mul_ps(w2, _mm256_loadu_ps(c2 + i)), _mm256_mul_ps(w3, _mm256_loadu_ps(c3 + i))));
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), sum));
+        }
+       #elif JUCE_USE_SSE_INTRINSICS
+        const auto w0 = _mm_set1_ps(weights[0]), w1 = _mm_set1_ps(weights[1]);
+        const auto w2 = _mm_set1_ps(weights[2]), w3 = _mm_set1_ps(weights[3]);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            auto sum = _mm_add_ps(_mm_mul_ps(w0, _mm_loadu_ps(c0 + i)), _mm_mul_ps(w1, _mm_loadu_ps(c1 + i)));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(w2, _mm_loadu_ps(c2 + i)), _mm_mul_ps(w3, _mm_loadu_ps(c3 + i))));
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), sum));
+        }
+       #elif JUCE_USE_ARM_NEON
+        const auto w0 = vdupq_n_f32(weights[0]), w1 = vdupq_n_f32(weights[1]);
+        const auto w2 = vdupq_n_f32(weights[2]), w3 = vdupq_n_f32(weights[3]);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            auto sum = vmlaq_f32(vld1q_f32(out + i), w0, vld1q_f32(c0 + i));
+            sum = vmlaq_f32(sum, w1, vld1q_f32(c1 + i));
+            sum = vmlaq_f32(sum, w2, vld1q_f32(c2 + i));
+            vst1q_f32(out + i, vmlaq_f32(sum, w3, vld1q_f32(c3 + i)));
+        }
+       #endif
+
+        // Whatever is left over, or everything if there is no vector unit
+        addScalar(out, corners, weights, numSamples, i);
+    }
+
+    // The weights for a position on the pad, x and y in 0..1 with (0, 0) at
+    // the top left. They always add up to 1.
+    inline void weightsAt(float x, float y, float* weights) noexcept
+    {
+        weights[0] = (1.0f - x) * (1.0f - y); // Top left
+        weights[1] = x * (1.0f - y);          // Top right
+        weights[2] = (1.0f - x) * y;          // Bottom left
+        weights[3] = x * y;                   // Bottom right
+    }
+
+    // As addScalar, but every weight moves in a straight line from its start
+    // value at sample 0 towards its end value at sample numSamples.
+    inline void addRampedScalar(float* out, const float* const* corners, const float* startWeights,
+                                const float* endWeights, int numSamples, int start = 0) noexcept
+    {
+        const float scale = 1.0f / (float) juce::jmax(1, numSamples);
+        float s[numCorners], d[numCorners];
+
+        for (int c = 0; c < numCorners; ++c)
+        {
+            s[c] = startWeights[c];
+            d[c] = (endWeights[c] - startWeights[c]) * scale;
+        }
+
+        for (int i = start; i < numSamples; ++i)
+        {
+            const auto t = (float) i;
+            out[i] += (s[0] + t * d[0]) * corners[0][i] + (s[1] + t * d[1]) * corners[1][i]
+                    + (s[2] + t * d[2]) * corners[2][i] + (s[3] + t * d[3]) * corners[3][i];
+        }
+    }
+
+    inline void addRampedVectorised(float* out, const float* const* corners, const float* startWeights,
+                                    const float* endWeights, int numSamples) noexcept
+    {
+        int i = 0;
+        const float scale = 1.0f / (float) juce::jmax(1, numSamples);
+
+       #if JUCE_USE_SSE_INTRINSICS && defined (__AVX__)
+        __m256 s[numCorners], d[numCorners];
+        for (int c = 0; c < numCorners; ++c)
+        {
+            s[c] = _mm256_set1_ps(startWeights[c]);
+            d[c] = _mm256_set1_ps((endWeights[c] - startWeights[c]) * scale);
+        }
+
+        // The weights are worked out from the sample index rather than stepped,
+        // so they land exactly on the end values whatever the block size
+        auto index = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const auto step = _mm256_set1_ps(8.0f);
+
+        for (; i + 8 <= numSamples; i += 8, index = _mm256_add_ps(index, step))
+        {
+            auto sum = _mm256_loadu_ps(out + i);
+
+            for (int c = 0; c < numCorners; ++c)
+            {
+                const auto weight = _mm256_add_ps(s[c], _mm256_mul_ps(d[c], index));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(weight, _mm256_loadu_ps(corners[c] + i)));
+            }
+
+            _mm256_storeu_ps(out + i, sum);
+        }
+       #elif JUCE_USE_SSE_INTRINSICS
+        __m128 s[numCorners], d[numCorners];
+        for (int c = 0; c < numCorners; ++c)
+        {
+            s[c] = _mm_set1_ps(startWeights[c]);
+            d[c] = _mm_set1_ps((endWeights[c] - startWeights[c]) * scale);
+        }
+
+        // The weights are worked out from the sample index rather than stepped,
+        // so they land exactly on the end values whatever the block size
+        auto index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const auto step = _mm_set1_ps(4.0f);
+
+        for (; i + 4 <= numSamples; i += 4, index = _mm_add_ps(index, step))
+        {
+            auto sum = _mm_loadu_ps(out + i);
+
+            for (int c = 0; c < numCorners; ++c)
+            {
+                const auto weight = _mm_add_ps(s[c], _mm_mul_ps(d[c], index));
+                sum = _mm_add_ps(sum, _mm_mul_ps(weight, _mm_loadu_ps(corners[c] + i)));
+            }
+
+            _mm_storeu_ps(out + i, sum);
+        }
+       #elif JUCE_USE_ARM_NEON
+        float32x4_t s[numCorners], d[numCorners];
+        for (int c = 0; c < numCorners; ++c)
+        {
+            s[c] = vdupq_n_f32(startWeights[c]);
+            d[c] = vdupq_n_f32((endWeights[c] - startWeights[c]) * scale);
+        }
+
+        const float firstIndex[] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        auto index = vld1q_f32(firstIndex);
+        const auto step = vdupq_n_f32(4.0f);
+
+        for (; i + 4 <= numSamples; i += 4, index = vaddq_f32(index, step))
+        {
+            auto sum = vld1q_f32(out + i);
+
+            for (int c = 0; c < numCorners; ++c)
+                sum = vmlaq_f32(sum, vmlaq_f32(s[c], d[c], index), vld1q_f32(corners[c] + i));
+
+            vst1q_f32(out + i, sum);
+        }
+       #endif
+
+        addRampedScalar(out, corners, startWeights, endWeights, numSamples, i);
+    }
+
+    // Mixes every channel of the four corner buffers into the output, adding
+    // to what is already there. The weights ramp from startWeights to
+    // endWeights over the range; pass the same array twice for fixed gains.
+    inline void addToBuffer(juce::AudioBuffer<float>& output, const juce::AudioBuffer<float>* const cornerBuffers,
+                            const float* startWeights, const float* endWeights, int startSample, int numSamples) noexcept
+    {
+        for (int channel = 0; channel < output.getNumChannels(); ++channel)
+        {
+            const float* corners[numCorners];
+
+            for (int c = 0; c < numCorners; ++c)
+                corners[c] = cornerBuffers[c].getReadPointer(channel % cornerBuffers[c].getNumChannels(), startSample);
+
+            auto* out = output.getWritePointer(channel, startSample);
+
+            if (startWeights == endWeights)
+                addVectorised(out, corners, startWeights, numSamples);
+            else
+                addRampedVectorised(out, corners, startWeights, endWeights, numSamples);
+        }
+    }
+
+    inline void addToBuffer(juce::AudioBuffer<float>& output, const juce::AudioBuffer<float>* const cornerBuffers,
+                            const float* weights, int numSamples) noexcept
+    {
+        addToBuffer(output, cornerBuffers, weights, weights, 0, numSamples);
+    }
+}
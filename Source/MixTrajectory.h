@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    MixTrajectory.h
+    Created: 14 May 2024 9:12:40am
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+
+// The Rnd Mix path: a loop through four random waypoints on the pad, x and y
+// in 0..1, run on the audio thread. Where the mix is on the loop is a phase
+// counted in segments, waypoint to waypoint, so when it follows the host it
+// can be worked out from the song position alone and the same transport
+// position always lands on the same point of the path.
+//
+// A loop started part way through a segment doesn't jump there: it leaves
+// from where the mix is and blends onto the path by the next waypoint.
+class MixTrajectory
+{
+public:
+    static constexpr int numWaypoints = 4;
+
+    enum class Shape { straight, smooth };
+
+    // Draws a new loop from seed, starting at 'from', with the phase at
+    // startPhase. The same seed always gives the same loop.
+    void start(juce::Point<float> from, juce::int64 seed, double startPhase)
+    {
+        juce::Random random(seed);
+        phase = wrap(startPhase);
+        const auto first = static_cast<int>(phase);
+
+        for (int i = 0; i < numWaypoints; ++i)
+            waypoints[(first + i) % numWaypoints] = i == 0 ? from : juce::Point<float>(random.nextFloat(), random.nextFloat());
+
+        entryFrom = from;
+        entryStart = phase;
+        entryLength = first + 1 - phase;
+    }
+
+    void setPhase(double newPhase)
+    {
+        phase = wrap(newPhase);
+        updateEntry();
+    }
+
+    // Moves along the path by a number of segments, and returns where that ends up
+    juce::Point<float> advance(double segments, Shape shape)
+    {
+        phase = wrap(phase + segments);
+        updateEntry();
+        return getPosition(shape);
+    }
+
+    juce::Point<float> getPosition(Shape shape) const
+    {
+        auto position = getPathPosition(phase, shape);
+
+        if (entryLength > 0.0)
+        {
+            // What's left of the gap between where the loop started and the path
+            const auto remaining = static_cast<float>(1.0 - (phase - entryStart) / entryLength);
+            position += (entryFrom - getPathPosition(entryStart, shape)) * remaining;
+        }
+
+        return position;
+    }
+
+private:
+    // Once the phase leaves the segment the loop started in, it's on the path
+    void updateEntry()
+    {
+        if (phase < entryStart || phase >= entryStart + entryLength)
+            entryLength = 0.0;
+    }
+
+    juce::Point<float> getPathPosition(double at, Shape shape) const
+    {
+        const auto index = static_cast<int>(at);
+        const auto t = static_cast<float>(at - index);
+        const auto p1 = waypoints[index];
+        const auto p2 = waypoints[(index + 1) % numWaypoints];
+
+        if (shape == Shape::straight)
+            return p1 + (p2 - p1) * t;
+
+        // Catmull-Rom through the waypoints, so the ball turns through them
+        // without stopping. It can overshoot the pad a little on sharp turns.
+        const auto p0 = waypoints[(index + numWaypoints - 1) % numWaypoints];
+        const auto p3 = waypoints[(index + 2) % numWaypoints];
+        const auto t2 = t * t, t3 = t2 * t;
+        const auto point = (p1 * 2.0f
+                            + (p2 - p0) * t
+                            + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2
+                            + (p3 - p0 + (p1 - p2) * 3.0f) * t3) * 0.5f;
+
+        return { juce::jlimit(0.0f, 1.0f, point.x), juce::jlimit(0.0f, 1.0f, point.y) };
+    }
+
+    static double wrap(double value)
+    {
+        value = std::fmod(value, static_cast<double>(numWaypoints));
+
+        if (value < 0.0)
+            value += numWaypoints;
+
+        return value < numWaypoints ? value : 0.0; // A tiny negative can round up to numWaypoints
+    }
+
+    juce::Point<float> waypoints[numWaypoints];
+    double phase = 0.0; // Segments into the loop, 0 up to numWaypoints
+
+    // Blending from where the loop started onto the path, while entryLength > 0
+    juce::Point<float> entryFrom;
+    double entryStart = 0.0, entryLength = 0.0;
+};
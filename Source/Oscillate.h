@@ -1,107 +1,194 @@
 #ifndef OSCILLATE_H  // If OSCILLATE_H is not defined
 #define OSCILLATE_H  // Define OSCILLATE_H
 
+#include <JuceHeader.h>
+#include "MixKernel.h"
 #include <vector>
 #include <algorithm>
 #include <numeric>
 #include <limits>
-#include <iostream>
 
+// Chops the signal into overlapping zones. Each zone replays a short snippet
+// from its own start and crossfades over the previous zone for the overlap.
+//
+// A snippet always starts where its zone starts, so every output sample is the
+// input at the same instant times a gain that depends only on where we are in
+// the current zone. That gain is precomputed into a table (one entry per
+// sample of the hop between zones), and the position in it carries over from
+// one block to the next. The result is the same whatever the host block size,
+// and processing a block is a single multiply per sample.
 class SampleOscillator {
 private:
-    static const int sampleRate = 44100;
-    int snippetDuration;
-    int zoneDuration;
-    int overlapRatio;
-    int overlapSamples;
-    void updateOverlapSamples() {
-        overlapSamples = overlapRatio * zoneDuration / 100;
+    static constexpr float defaultFrequency = 440.0f;
+    static constexpr int defaultSnippetsPerZone = 4;
+    static constexpr float defaultOverlapPercent = 50.0f;
+    static constexpr double maxZoneSeconds = 1.0;
+
+    double sampleRate = 44100.0;
+    float snippetFrequency = defaultFrequency;
+    double zoneSeconds = defaultSnippetsPerZone / defaultFrequency;
+    float overlapPercent = defaultOverlapPercent;
+
+    std::vector<float> gainTable; // Sized in prepare(), never reallocated afterwards
+    int hopLength = 1;
+    int snippetLength = 1;
+    int phase = 0;               // Position within the current hop
+    bool isFirstZone = true;     // The first zone has nothing to crossfade with
+
+    void updateGainTable() {
+        const auto maxLength = static_cast<int>(gainTable.size());
+        snippetLength = std::max(1, static_cast<int>(sampleRate / snippetFrequency));
+
+        // Make sure the snippetLength is a divisor of zoneLength.
+        int zoneLength = static_cast<int>(zoneSeconds * sampleRate);
+        zoneLength = std::max(snippetLength, zoneLength / snippetLength * snippetLength);
+        zoneLength = std::min(zoneLength, maxLength);
+
+        int overlapSamples = static_cast<int>(zoneLength * overlapPercent / 100.0f);
+        if (overlapSamples >= zoneLength)
+            overlapSamples = zoneLength / 2;
+
+        hopLength = std::max(1, zoneLength - overlapSamples);
+
+        // gain(j) for a position j within a zone: the snippet is live for its
+        // first snippetLength samples, silent after that, and during the
+        // overlap it is faded in over whatever the previous zone left there.
+        // Filled from the back so gain(j + hop) is ready when gain(j) needs it.
+        for (int j = zoneLength; --j >= 0;) {
+            const float snippet = j < snippetLength ? 1.0f : 0.0f;
+
+            if (j < overlapSamples) {
+                const float crossfadeFactor = static_cast<float>(j) / overlapSamples;
+                gainTable[(size_t) j] = crossfadeFactor * snippet + (1.0f - crossfadeFactor) * gainTable[(size_t) (j + hopLength)];
+            } else {
+                gainTable[(size_t) j] = snippet;
+            }
+        }
+
+        phase = std::min(phase, hopLength - 1);
     }
-    
 
 public:
-    SampleOscillator()
-    : snippetDuration(sampleRate / 220), // Initialize tuned for 220Hz
-      zoneDuration(sampleRate / 20), // Initialize for 0.05 seconds
-      overlapRatio(68) // Initialize to 68% overlap
-    {
-        updateOverlapSamples();
+    SampleOscillator() = default;
+
+    // Allocates the gain table. Call before processing, off the audio thread.
+    void prepare(double newSampleRate) {
+        sampleRate = newSampleRate;
+        gainTable.assign(static_cast<size_t>(maxZoneSeconds * sampleRate) + 1, 0.0f);
+        updateGainTable();
+        reset();
+    }
+
+    void reset() {
+        phase = 0;
+        isFirstZone = true;
     }
 
-    // Method to update snippet duration, zone duration, and overlap ratio
-    void updateParameters(int frequencyHz, double durationInSeconds, int newOverlapRatio) {
-        snippetDuration = sampleRate / frequencyHz;
-        zoneDuration = static_cast<int>(durationInSeconds * sampleRate);
-        overlapRatio = newOverlapRatio;
-        updateOverlapSamples();
+    // Snippet pitch in Hz, zone length in seconds and zone overlap in percent.
+    // Does not allocate, so it is safe to call between blocks on the audio thread.
+    void updateParameters(float frequencyHz, double durationInSeconds, float newOverlapPercent) {
+        snippetFrequency = std::max(1.0f, frequencyHz);
+        zoneSeconds = std::max(0.0, durationInSeconds);
+        overlapPercent = std::clamp(newOverlapPercent, 0.0f, 99.0f);
+
+        if (! gainTable.empty())
+            updateGainTable();
     }
 
-    // Method to process and mix four buffers
+    // Processes every channel of the buffer in place. All channels share the
+    // same zone position, which advances by numSamples.
+    void process(juce::AudioBuffer<float>& buffer, int numSamples) {
+        process(buffer, 0, numSamples);
+    }
+
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) {
+        jassert(! gainTable.empty()); // prepare() hasn't been called
+
+        for (int done = 0; done < numSamples;) {
+            const int num = std::min(numSamples - done, hopLength - phase);
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+                auto* data = buffer.getWritePointer(channel, startSample + done);
+
+                if (isFirstZone) {
+                    // Nothing to crossfade with yet, so just the snippet gate
+                    const int live = std::clamp(snippetLength - phase, 0, num);
+                    juce::FloatVectorOperations::clear(data + live, num - live);
+                } else {
+                    juce::FloatVectorOperations::multiply(data, gainTable.data() + phase, num);
+                }
+            }
+
+            done += num;
+            phase += num;
+
+            if (phase >= hopLength) {
+                phase = 0;
+                isFirstZone = false;
+            }
+        }
+    }
+
+    // Method to process and mix four buffers. Works in float and sums all
+    // four through the BilinearMix kernel, so the only clamp is the final
+    // conversion back to int16.
     void processAndMixBuffers(const std::vector<short>& buffer1,
                               const std::vector<short>& buffer2,
                               const std::vector<short>& buffer3,
                               const std::vector<short>& buffer4,
                               std::vector<short>& mixBuffer) {
-        
-        // Process each buffer
-        std::vector<short> oscBuffer1 = oscillateBuffer(buffer1);
-        std::vector<short> oscBuffer2 = oscillateBuffer(buffer2);
-        std::vector<short> oscBuffer3 = oscillateBuffer(buffer3);
-        std::vector<short> oscBuffer4 = oscillateBuffer(buffer4);
-
-        // Ensure the mixBuffer is clear and has the proper size
-        mixBuffer.clear();
-        mixBuffer.resize(oscBuffer1.size(), 0);
-
-        // Sum the processed buffers into mixBuffer
-        for (size_t i = 0; i < mixBuffer.size(); ++i) {
-            int mixedSample = 0;
-            if (i < oscBuffer1.size()) mixedSample += oscBuffer1[i];
-            if (i < oscBuffer2.size()) mixedSample += oscBuffer2[i];
-            if (i < oscBuffer3.size()) mixedSample += oscBuffer3[i];
-            if (i < oscBuffer4.size()) mixedSample += oscBuffer4[i];
-
-            // Clipping prevention
-            mixedSample = std::max(std::min(mixedSample, (int)std::numeric_limits<short>::max()), (int)std::numeric_limits<short>::min());
-
-            mixBuffer[i] = mixedSample;
+        const std::vector<short>* inputs[] = { &buffer1, &buffer2, &buffer3, &buffer4 };
+        const int length = static_cast<int>(buffer1.size());
+
+        // Shorter inputs are padded with silence
+        juce::AudioBuffer<float> corners[BilinearMix::numCorners];
+        for (int c = 0; c < BilinearMix::numCorners; ++c) {
+            corners[c].setSize(1, length);
+            corners[c].clear();
+            toFloat(*inputs[c], corners[c].getWritePointer(0), length);
+            oscillateFloat(corners[c]);
         }
+
+        juce::AudioBuffer<float> mix(1, length);
+        mix.clear();
+        const float unityWeights[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        BilinearMix::addToBuffer(mix, corners, unityWeights, length);
+
+        mixBuffer.resize(buffer1.size());
+        toShort(mix.getReadPointer(0), mixBuffer);
     }
-    /// Method to oscillate a single buffer
+
+    /// Oscillates a whole int16 buffer from the start of a zone. Allocates, so
+    /// it is for offline use only; the audio thread uses process().
     std::vector<short> oscillateBuffer(const std::vector<short>& buffer) {
-        std::vector<short> outputSamples(buffer.size(), 0);
-        float frequency = 440.0f;
-        float sampleRate = 44100.0f;
-        size_t snippetLength = static_cast<size_t>(sampleRate / frequency);
-        size_t zoneLength = snippetLength * 4;
+        juce::AudioBuffer<float> floatBuffer(1, static_cast<int>(buffer.size()));
+        toFloat(buffer, floatBuffer.getWritePointer(0), floatBuffer.getNumSamples());
+        oscillateFloat(floatBuffer);
 
-        // Make sure the snippetLength is a divisor of zoneLength.
-        zoneLength = zoneLength / snippetLength * snippetLength;
+        std::vector<short> outputSamples(buffer.size());
+        toShort(floatBuffer.getReadPointer(0), outputSamples);
+        return outputSamples;
+    }
 
-        float overlapPercentage = 0.5; // 50% overlap
-        size_t overlapSamples = static_cast<size_t>(zoneLength * overlapPercentage);
-        if (zoneLength <= overlapSamples) {
-            std::cerr << "Error: overlapSamples is greater than or equal to zoneLength, adjusting overlapSamples." << std::endl;
-            overlapSamples = zoneLength / 2; // Adjust overlapSamples to be half of zoneLength
-        }
+private:
+    // Runs a fresh copy of this oscillator over the buffer, leaving our own
+    // zone position alone
+    void oscillateFloat(juce::AudioBuffer<float>& floatBuffer) const {
+        SampleOscillator oscillator;
+        oscillator.prepare(sampleRate);
+        oscillator.updateParameters(snippetFrequency, zoneSeconds, overlapPercent);
+        oscillator.process(floatBuffer, floatBuffer.getNumSamples());
+    }
 
-        for (size_t i = 0; i + zoneLength <= buffer.size(); i += zoneLength - overlapSamples) {
-            std::vector<short> snippet(buffer.begin() + i, buffer.begin() + i + snippetLength);
-            snippet.resize(zoneLength, 0); // Extend the snippet to fill the zone
-
-            for (size_t j = 0; j < zoneLength; ++j) {
-                if (i + j < outputSamples.size()) {
-                    float crossfadeFactor = j < overlapSamples ? static_cast<float>(j) / overlapSamples : 1.0f;
-                    float inverseCrossfadeFactor = 1.0f - crossfadeFactor;
-                    if (j < overlapSamples && i != 0) {
-                        outputSamples[i + j] = static_cast<short>(crossfadeFactor * snippet[j] + inverseCrossfadeFactor * outputSamples[i + j]);
-                    } else {
-                        outputSamples[i + j] = snippet[j];
-                    }
-                }
-            }
-        }
-    return outputSamples;
+    static void toFloat(const std::vector<short>& source, float* dest, int maxSamples) {
+        const int num = std::min(maxSamples, static_cast<int>(source.size()));
+        for (int i = 0; i < num; ++i)
+            dest[i] = source[(size_t) i] / 32768.0f;
+    }
+
+    static void toShort(const float* source, std::vector<short>& dest) {
+        for (size_t i = 0; i < dest.size(); ++i)
+            dest[i] = static_cast<short>(std::clamp(source[i] * 32768.0f, -32768.0f, 32767.0f));
     }
 
 };
@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    PerfCounters.h
+    Created: 16 May 2024 2:37:15pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// How much of each block's deadline the audio thread uses, stage by stage,
+// for the performance overlay. The audio thread only ever stores into
+// atomics it alone writes, so nothing waits on anything. While the overlay
+// is hidden, timing is off and every stage costs one bool check.
+class PerfCounters
+{
+public:
+    enum Stage { sources, oscillators, mix, filters, reverb, numStages };
+
+    // Block time as a share of the deadline: ten bins of 10% up to 100%,
+    // then up to 150%, then anything later
+    static constexpr int numBins = 12;
+
+    static const char* getStageName(int stage)
+    {
+        static const char* const names[] = { "Sources", "Oscillators", "Mix", "Filters", "Reverb" };
+        return names[stage];
+    }
+
+    struct Snapshot
+    {
+        float blockLoad = 0.0f, peakLoad = 0.0f; // Shares of the deadline, smoothed and highest
+        float stageLoad[numStages] = {};
+        juce::uint32 histogram[numBins] = {};
+        juce::uint32 numBlocks = 0, numLateBlocks = 0;
+    };
+
+    PerfCounters() {}
+
+    // Message thread
+    void setEnabled(bool shouldBeEnabled) { enabled.store(shouldBeEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    void reset() { resetRequested.store(true, std::memory_order_relaxed); }
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.blockLoad = blockLoad.load(std::memory_order_relaxed);
+        snapshot.peakLoad = peakLoad.load(std::memory_order_relaxed);
+
+        for (int s = 0; s < numStages; ++s)
+            snapshot.stageLoad[s] = stageLoad[(size_t) s].load(std::memory_order_relaxed);
+
+        for (int b = 0; b < numBins; ++b)
+            snapshot.histogram[b] = histogram[(size_t) b].load(std::memory_order_relaxed);
+
+        snapshot.numBlocks = numBlocks.load(std::memory_order_relaxed);
+        snapshot.numLateBlocks = numLateBlocks.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    //==============================================================================
+    // Audio thread, at the start and end of processBlock
+    void beginBlock() noexcept
+    {
+        active = enabled.load(std::memory_order_relaxed);
+
+        if (! active)
+            return;
+
+        if (resetRequested.exchange(false, std::memory_order_relaxed))
+            clear();
+
+        stageTicks.fill(0);
+        blockStart = juce::Time::getHighResolutionTicks();
+    }
+
+    void endBlock(int numSamples, double sampleRate) noexcept
+    {
+        if (! active || numSamples <= 0 || sampleRate <= 0.0)
+            return;
+
+        const auto deadlineTicks = numSamples / sampleRate * (double) juce::Time::getHighResolutionTicksPerSecond();
+        const auto load = (float) ((double) (juce::Time::getHighResolutionTicks() - blockStart) / deadlineTicks);
+        const auto bin = load < 1.0f ? juce::jlimit(0, 9, (int) (load * 10.0f)) : load < 1.5f ? 10 : 11;
+
+        increment(histogram[(size_t) bin]);
+        increment(numBlocks);
+
+        if (load >= 1.0f)
+            increment(numLateBlocks);
+
+        // About a second of blocks to settle, so the figures can be read
+        smooth(blockLoad, load);
+
+        for (int s = 0; s < numStages; ++s)
+            smooth(stageLoad[(size_t) s], (float) ((double) stageTicks[(size_t) s] / deadlineTicks));
+
+        if (load > peakLoad.load(std::memory_order_relaxed))
+            peakLoad.store(load, std::memory_order_relaxed);
+    }
+
+    // Times one stage for as long as it's in scope. The same stage can be
+    // timed several times in a block; the times add up.
+    class ScopedStage
+    {
+    public:
+        ScopedStage(PerfCounters& countersToUse, Stage stageToTime) noexcept
+            : counters(countersToUse), stage(stageToTime),
+              start(counters.active ? juce::Time::getHighResolutionTicks() : 0) {}
+
+        ~ScopedStage()
+        {
+            if (counters.active)
+                counters.stageTicks[(size_t) stage] += juce::Time::getHighResolutionTicks() - start;
+        }
+
+    private:
+        PerfCounters& counters;
+        const Stage stage;
+        const juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedStage)
+    };
+
+private:
+    // Only the audio thread writes these, so a load and a store will do
+    static void increment(std::atomic<juce::uint32>& counter) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static void smooth(std::atomic<float>& value, float latest) noexcept
+    {
+        const auto previous = value.load(std::memory_order_relaxed);
+        value.store(previous + (latest - previous) * 0.02f, std::memory_order_relaxed);
+    }
+
+    void clear() noexcept
+    {
+        for (auto& bin : histogram)
+            bin.store(0, std::memory_order_relaxed);
+
+        for (auto& load : stageLoad)
+            load.store(0.0f, std::memory_order_relaxed);
+
+        numBlocks.store(0, std::memory_order_relaxed);
+        numLateBlocks.store(0, std::memory_order_relaxed);
+        blockLoad.store(0.0f, std::memory_order_relaxed);
+        peakLoad.store(0.0f, std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> enabled { false }, resetRequested { false };
+
+    // Audio thread only
+    bool active = false;
+    juce::int64 blockStart = 0;
+    std::array<juce::int64, numStages> stageTicks {};
+
+    // Written by the audio thread, read by the overlay
+    std::array<std::atomic<float>, numStages> stageLoad {};
+    std::array<std::atomic<juce::uint32>, numBins> histogram {};
+    std::atomic<juce::uint32> numBlocks { 0 }, numLateBlocks { 0 };
+    std::atomic<float> blockLoad { 0.0f }, peakLoad { 0.0f };
+
+    JUCE_DECLARE_NON_COPYABLE(PerfCounters)
+};
@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    PerfOverlay.h
+    Created: 16 May 2024 4:05:51pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+// The performance HUD: how much of the block deadline each stage uses, a
+// histogram of whole-block times against the deadline, and the counts of late
+// blocks, stream underruns and waits on the render workers. The processor
+// only times anything while this is showing. Click it to start the counts again.
+class PerfOverlay : public juce::Component,
+                    private juce::Timer
+{
+public:
+    explicit PerfOverlay(SpecterAudioProcessor& p) : processor(p)
+    {
+        setInterceptsMouseClicks(true, false);
+    }
+
+    ~PerfOverlay() override
+    {
+        processor.perfCounters.setEnabled(false);
+    }
+
+    void visibilityChanged() override
+    {
+        processor.perfCounters.setEnabled(isVisible());
+
+        if (isVisible())
+            startTimerHz(10);
+        else
+            stopTimer();
+    }
+
+    void mouseDown(const juce::MouseEvent&) override
+    {
+        processor.perfCounters.reset();
+        underrunsAtReset = processor.getNumStreamUnderruns();
+        waitsAtReset = processor.getNumRenderWorkerWaits();
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        const auto stats = processor.perfCounters.getSnapshot();
+        auto area = getLocalBounds().toFloat();
+
+        g.setColour(juce::Colours::black.withAlpha(0.8f));
+        g.fillRoundedRectangle(area, 4.0f);
+        area = area.reduced(8.0f);
+        g.setFont(12.0f);
+
+        const auto percent = [] (float share) { return juce::String(juce::roundToInt(share * 100.0f)) + "%"; };
+        const auto line = [&area] { return area.removeFromTop(15.0f); };
+
+        g.setColour(juce::Colours::white);
+        g.drawText("Block " + percent(stats.blockLoad) + " of deadline, peak " + percent(stats.peakLoad),
+                   line(), juce::Justification::centredLeft);
+        area.removeFromTop(4.0f);
+
+        // One bar per stage, full width being the whole deadline
+        for (int s = 0; s < PerfCounters::numStages; ++s)
+        {
+            auto row = line();
+            g.setColour(juce::Colours::lightgrey);
+            g.drawText(PerfCounters::getStageName(s), row.removeFromLeft(70.0f), juce::Justification::centredLeft);
+            g.drawText(percent(stats.stageLoad[s]), row.removeFromRight(36.0f), juce::Justification::centredRight);
+            g.setColour(juce::Colours::limegreen);
+            g.fillRect(row.reduced(2.0f, 4.0f).withWidth(row.reduced(2.0f, 4.0f).getWidth() * juce::jmin(1.0f, stats.stageLoad[s])));
+        }
+
+        area.removeFromTop(6.0f);
+
+        // Block times: ten bins up to the deadline, then late and very late
+        auto histogram = area.removeFromTop(40.0f);
+        juce::uint32 tallest = 1;
+
+        for (auto count : stats.histogram)
+            tallest = juce::jmax(tallest, count);
+
+        const auto binWidth = histogram.getWidth() / PerfCounters::numBins;
+
+        for (int b = 0; b < PerfCounters::numBins; ++b)
+        {
+            const auto height = histogram.getHeight() * (float) stats.histogram[b] / (float) tallest;
+            g.setColour(b < 10 ? juce::Colours::lightgrey : juce::Colours::red);
+            g.fillRect(histogram.getX() + b * binWidth + 1.0f, histogram.getBottom() - height, binWidth - 2.0f, height);
+        }
+
+        auto labels = line();
+        g.setColour(juce::Colours::grey);
+        g.drawText("0%", labels, juce::Justification::centredLeft);
+        g.drawText("100%", labels.withTrimmedRight(binWidth * 2.0f), juce::Justification::centredRight);
+        area.removeFromTop(4.0f);
+
+        g.setColour(juce::Colours::white);
+        g.drawText("Late blocks " + juce::String(stats.numLateBlocks) + " of " + juce::String(stats.numBlocks),
+                   line(), juce::Justification::centredLeft);
+        g.drawText("Stream underruns " + juce::String(processor.getNumStreamUnderruns() - underrunsAtReset),
+                   line(), juce::Justification::centredLeft);
+        g.drawText("Render worker waits " + juce::String(processor.getNumRenderWorkerWaits() - waitsAtReset),
+                   line(), juce::Justification::centredLeft);
+    }
+
+private:
+    void timerCallback() override { repaint(); }
+
+    SpecterAudioProcessor& processor;
+    int underrunsAtReset = 0, waitsAtReset = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerfOverlay)
+};
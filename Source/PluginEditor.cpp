@@ -16,13 +16,14 @@
 SpecterAudioProcessorEditor::SpecterAudioProcessorEditor (SpecterAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
 {
-    // Initialize the ball position from the processor
-    ballPosition = juce::Point<float>(audioProcessor.ballPosX.load() * getWidth(), 
-                                      audioProcessor.ballPosY.load() * getHeight());
     // Adjust the size to add space for the toolbar
     int toolbarHeight = 50;
     setSize(600, 400 + toolbarHeight);
 
+    // Put the ball back where the processor's mix is
+    ballPosition = getBallTravelArea().getRelativePoint(audioProcessor.getMixPosition().x,
+                                                        audioProcessor.getMixPosition().y);
+
     // Set up the folderButton
     folderButton.setButtonText("Load");
     folderButton.addListener(this);
@@ -33,13 +34,17 @@ SpecterAudioProcessorEditor::SpecterAudioProcessorEditor (SpecterAudioProcessor&
     diceButton.addListener(this);
     diceButton.setEnabled(false); // Disable until a folder is selected
     addAndMakeVisible(diceButton);
-    ballPosition = { getWidth() * 0.5f, getHeight() * 0.5f };
+
+    // A for anything, K for a similar key, B for similar brightness
+    diceMatchButton.addListener(this);
+    addAndMakeVisible(diceMatchButton);
+    updateDiceMatchButton();
     
     // Set up the loopButton
     loopButton.setButtonText("Loop");
     loopButton.addListener(this);
     addAndMakeVisible(loopButton);
-    loopButton.setToggleState(true, juce::dontSendNotification);
+    loopButton.setToggleState(audioProcessor.getLooping(), juce::dontSendNotification);
     
     isDragging = false;
     
@@ -51,13 +56,16 @@ SpecterAudioProcessorEditor::SpecterAudioProcessorEditor (SpecterAudioProcessor&
     rndMixButton.addListener(this);
     rndMixButton.setEnabled(true); // Enable or disable as per your needs
     addAndMakeVisible(rndMixButton);
+
+    // Only checks for new files; the ball is redrawn on the display's vblank
     startTimerHz(4);
     
-    // Initialize the timerHzSlider
-    timerHzSlider.setRange(30.0, 500.0, 0.1);
-    timerHzSlider.setValue(200); // Starting value (you had startTimerHz(4) before)
-    timerHzSlider.addListener(this);
-    addAndMakeVisible(timerHzSlider);
+    // How long Rnd Mix takes from one waypoint to the next, in seconds
+    rndMixTimeSlider.setRange(0.05, 10.0, 0.01);
+    rndMixTimeSlider.setSkewFactorFromMidPoint(1.0);
+    rndMixTimeSlider.setValue(audioProcessor.apvts.getRawParameterValue("rndMixTime")->load(), juce::dontSendNotification);
+    rndMixTimeSlider.addListener(this);
+    addAndMakeVisible(rndMixTimeSlider);
     
     // Set up the stopButton
     stopButton.setButtonText("Stop");
@@ -84,6 +92,29 @@ SpecterAudioProcessorEditor::SpecterAudioProcessorEditor (SpecterAudioProcessor&
     oscillatorButton.setEnabled(true); // Enable or disable as per your needs
     addAndMakeVisible(oscillatorButton);
     
+    cornerFilterButton.setButtonText("//");
+    cornerFilterButton.addListener(this);
+    addAndMakeVisible(cornerFilterButton);
+
+    cornerFilterOffButton.setButtonText("\\\\");
+    cornerFilterOffButton.addListener(this);
+    addAndMakeVisible(cornerFilterOffButton);
+
+    spectralButton.setButtonText("<>");
+    spectralButton.addListener(this);
+    addAndMakeVisible(spectralButton);
+
+    spectralOffButton.setButtonText("><");
+    spectralOffButton.addListener(this);
+    addAndMakeVisible(spectralOffButton);
+
+    // Hidden until asked for; the processor doesn't time anything until then
+    perfButton.setButtonText("%");
+    perfButton.setClickingTogglesState(true);
+    perfButton.addListener(this);
+    addAndMakeVisible(perfButton);
+    addChildComponent(perfOverlay);
+
     secondRowButton1.setButtonText("\\");
     secondRowButton1.addListener(this);
     secondRowButton1.setEnabled(true); // Enable or disable as per your needs
@@ -103,11 +134,29 @@ SpecterAudioProcessorEditor::SpecterAudioProcessorEditor (SpecterAudioProcessor&
     secondRowButton4.addListener(this);
     secondRowButton4.setEnabled(true); // Enable or disable as per your needs
     addAndMakeVisible(secondRowButton4);
+
+    for (auto& thumbnail : thumbnails)
+    {
+        thumbnail = std::make_unique<juce::AudioThumbnail>(512, thumbnailCache->formatManager, thumbnailCache->cache);
+        thumbnail->addChangeListener(this);
+    }
+
+    // Everything but the ball, meters and playheads comes from the cached background
+    setOpaque(true);
+
+   #if SPECTER_USE_OPENGL
+    openGLContext.attachTo(*this);
+   #endif
 }
 
 SpecterAudioProcessorEditor::~SpecterAudioProcessorEditor()
 {
-    // Your cleanup code here
+    for (auto& thumbnail : thumbnails)
+        thumbnail->removeChangeListener(this);
+
+   #if SPECTER_USE_OPENGL
+    openGLContext.detach();
+   #endif
 }
 
 void SpecterAudioProcessorEditor::buttonClicked(juce::Button* button)
@@ -115,67 +164,35 @@ void SpecterAudioProcessorEditor::buttonClicked(juce::Button* button)
     
     if (button == &folderButton)
     {
-        juce::FileChooser chooser("Select a folder containing .wav or .aif files", juce::File::getSpecialLocation(juce::File::userHomeDirectory), "");
+        // Shift-click walks the folder again instead of using the saved index
+        const bool forceRescan = juce::ModifierKeys::currentModifiers.isShiftDown();
 
-        if (chooser.browseForDirectory())
-        {
-            juce::File folder = chooser.getResult();
-
-            audioFiles.clear(); // Clear the previous list
+        folderChooser = std::make_unique<juce::FileChooser>("Select a folder of audio files",
+                                                            juce::File::getSpecialLocation(juce::File::userHomeDirectory), "");
 
-            // Fetch .wav files
-            folder.findChildFiles(audioFiles, juce::File::findFiles, false, "*.wav");
-
-            // Fetch .aif files
-            folder.findChildFiles(audioFiles, juce::File::findFiles, false, "*.aif");
+        folderChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+                                   [this, forceRescan] (const juce::FileChooser& chooser)
+        {
+            const auto folder = chooser.getResult();
 
-            // Log the results
-            juce::String message = "Found " + juce::String(audioFiles.size()) + " audio files.";
-            juce::Logger::writeToLog(message);
-            
-            if (audioFiles.size() > 0)
+            if (folder.isDirectory())
             {
-                juce::Array<juce::File> filesToPlay;
-                for (int i = 0; i < juce::jmin(4, audioFiles.size()); ++i)
-                {
-                    filesToPlay.add(audioFiles[i]);
-                }
-
-                // Get the processor and update it with the new files
-                auto* processor = dynamic_cast<SpecterAudioProcessor*>(getAudioProcessor());
-                if (processor != nullptr)  // Always check for a valid pointer after a dynamic_cast
-                {
-                    processor->loadFiles(filesToPlay);     // Load the files for playback
-                    processor->updateAudioFiles(audioFiles); // Update the processor with the full list of files
-                }
-            }       
-
-            diceButton.setEnabled(audioFiles.size() >= 4);
-        }
+                // Files come in from the scanner as it finds them; the timer picks them up
+                audioProcessor.scanLibrary(folder, forceRescan);
+                diceButton.setEnabled(false);
+                repaint();
+            }
+        });
     }
   else if (button == &diceButton)
 {
-    if (audioFiles.size() >= 4)
+    if (audioProcessor.getAudioFiles().size() >= 4)
     {
-        // Shuffle the audioFiles array to randomize
-            juce::Random r;
-            for (int i = audioFiles.size(); --i >= 1;)
-            {
-                auto swapIndex = r.nextInt(i + 1);
-                audioFiles.swap(swapIndex, i);
-            }
-
-            // Now pick the first four files after shuffling
-            juce::Array<juce::File> filesToPlay = { audioFiles[0], audioFiles[1], audioFiles[2], audioFiles[3] };
-
-            // Pass the files to the processor
-            auto* processor = dynamic_cast<SpecterAudioProcessor*>(getAudioProcessor());
-            if (processor != nullptr)
-            {
-                processor->loadFiles(filesToPlay);
-            }
-            processor->updateAudioFiles(audioFiles);
-            repaint(); // This will trigger a repaint to update any UI components
+            // The processor picks the files and has usually decoded them already,
+            // so this returns straight away
+            audioProcessor.rollDice();
+            if (updateBackground()) // Show the new file names
+                repaint();
     }
     else
     {
@@ -183,6 +200,12 @@ void SpecterAudioProcessorEditor::buttonClicked(juce::Button* button)
         juce::Logger::writeToLog("Not enough audio files to shuffle and pick four.");
     }
 }
+    if (button == &diceMatchButton)
+    {
+        const auto match = static_cast<int>(audioProcessor.apvts.getRawParameterValue("diceMatch")->load());
+        audioProcessor.setParameterValue("diceMatch", (float) ((match + 1) % 3));
+        updateDiceMatchButton();
+    }
     if (button == &loopButton)
     {
         // Cast getAudioProcessor() to your processor type
@@ -194,32 +217,13 @@ void SpecterAudioProcessorEditor::buttonClicked(juce::Button* button)
     }
      else if (button == &rndMixButton)
     {
-        // Ensure no movement is happening while setting up new points
-        shouldMoveBall = false;
-
-        // Generate 4 random points for the joystick to move to
-        for (int i = 0; i < 4; ++i)
-        {
-            points[i].x = juce::Random::getSystemRandom().nextFloat() * (getWidth() - 30) + 15; // 15 and 30 are ball radii and diameter
-            points[i].y = juce::Random::getSystemRandom().nextFloat() * (getHeight() - 30 - 50) + 50 + 15; // 50 is the toolbar height
-        }
-
-        currentPointIndex = 0; // Reset the current point index
-
-        // Set the initial ball position to the first point to avoid a visual jump
-        ballPosition = points[0];
-        
-        int timerInterval = static_cast<int>(1000.0 / timerHzSlider.getValue());
-
-        // Restart the timer here if it's not always running
-        startTimer(timerInterval);
-
-        // Now allow the ball to move
-        shouldMoveBall = true;
+        // The processor draws four new waypoints and moves the mix itself,
+        // editor or not; the ball just follows
+        audioProcessor.startRandomMix();
     }
     else if (button == &stopButton)
     {
-        shouldMoveBall = false; // This will stop the ball from moving
+        audioProcessor.stopRandomMix();
     }
     if (button == &reverbButton)
     {
@@ -227,55 +231,83 @@ void SpecterAudioProcessorEditor::buttonClicked(juce::Button* button)
         audioProcessor.randomizeReverbParameters();
 
         // Ensure the reverb is turned on
-        audioProcessor.apvts.getParameterAsValue("reverbButton").setValue(true);
+        audioProcessor.setParameterValue("reverbButton", 1.0f);
     }
     if (button == &filterButton)
     {
         // Randomize the reverb parameters every time the button is clicked
         audioProcessor.randomizeLowPassFilterParameters();
 
-        audioProcessor.apvts.getParameterAsValue("filterButton").setValue(true);
+        audioProcessor.setParameterValue("filterButton", 1.0f);
+    }
+    if (button == &cornerFilterButton)
+    {
+        // A different random filter on each corner
+        audioProcessor.randomizeCornerFilterParameters();
+        audioProcessor.setParameterValue("cornerFilterButton", 1.0f);
+    }
+    if (button == &cornerFilterOffButton)
+    {
+        audioProcessor.setParameterValue("cornerFilterButton", 0.0f);
+    }
+    if (button == &spectralButton)
+    {
+        audioProcessor.setParameterValue("spectralButton", 1.0f);
+    }
+    if (button == &spectralOffButton)
+    {
+        audioProcessor.setParameterValue("spectralButton", 0.0f);
+    }
+    if (button == &perfButton)
+    {
+        perfOverlay.setVisible(perfButton.getToggleState());
     }
     if (button == &oscillatorButton)
     {
 
         // Ensure the effect is turned on
-        audioProcessor.apvts.getParameterAsValue("oscillatorButton").setValue(true);
+        audioProcessor.setParameterValue("oscillatorButton", 1.0f);
     }
     if (button == &secondRowButton1)
     {
 
         // Ensure the effect is turned on
-        audioProcessor.apvts.getParameterAsValue("filterButton").setValue(false);
+        audioProcessor.setParameterValue("filterButton", 0.0f);
     }
     if (button == &secondRowButton2)
     {
 
         // Ensure the effect is turned on
-        audioProcessor.apvts.getParameterAsValue("reverbButton").setValue(false);
+        audioProcessor.setParameterValue("reverbButton", 0.0f);
     }
     if (button == &secondRowButton4)
     {
 
         // Ensure the effect is turned on
-        audioProcessor.apvts.getParameterAsValue("oscillatorButton").setValue(false);
+        audioProcessor.setParameterValue("oscillatorButton", 0.0f);
     }
     if (button == &granularButton)
     {
         audioProcessor.randomizeReverbParameters();
-        audioProcessor.apvts.getParameterAsValue("reverbButton").setValue(true);
+        audioProcessor.setParameterValue("reverbButton", 1.0f);
         audioProcessor.randomizeLowPassFilterParameters();
-        audioProcessor.apvts.getParameterAsValue("filterButton").setValue(true);
+        audioProcessor.setParameterValue("filterButton", 1.0f);
+        audioProcessor.randomizeCornerFilterParameters();
+        audioProcessor.setParameterValue("cornerFilterButton", 1.0f);
         // Ensure the effect is turned on
-        audioProcessor.apvts.getParameterAsValue("oscillatorButton").setValue(true);
+        audioProcessor.setParameterValue("oscillatorButton", 1.0f);
+        audioProcessor.randomizeGranularParameters();
+        audioProcessor.setParameterValue("granularButton", 1.0f);
     }
     if (button == &secondRowButton3)
     {
 
         // Ensure the effect is turned on
-        audioProcessor.apvts.getParameterAsValue("oscillatorButton").setValue(false);
-        audioProcessor.apvts.getParameterAsValue("reverbButton").setValue(false);
-        audioProcessor.apvts.getParameterAsValue("filterButton").setValue(false);
+        audioProcessor.setParameterValue("oscillatorButton", 0.0f);
+        audioProcessor.setParameterValue("reverbButton", 0.0f);
+        audioProcessor.setParameterValue("filterButton", 0.0f);
+        audioProcessor.setParameterValue("cornerFilterButton", 0.0f);
+        audioProcessor.setParameterValue("granularButton", 0.0f);
     }
 
 }
@@ -285,11 +317,64 @@ void SpecterAudioProcessorEditor::buttonClicked(juce::Button* button)
 //==============================================================================
 void SpecterAudioProcessorEditor::paint(juce::Graphics& g)
 {
-    auto* processor = dynamic_cast<SpecterAudioProcessor*>(getAudioProcessor());
-    if (processor == nullptr) return; // Exit if the processor is not the expected type
+    if (background.isNull())
+        updateBackground();
+
+    g.drawImage(background, getLocalBounds().toFloat());
+
+    for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+    {
+        if (meterLevels[c] > 0.0f)
+        {
+            const auto meter = getMeterBounds(c);
+            g.setColour(juce::Colours::limegreen.withAlpha(0.8f));
+            g.fillRect(meter.withTop(meter.getBottom() - meter.getHeight() * meterLevels[c]));
+        }
+
+        if (playheads[c] >= 0.0f)
+        {
+            g.setColour(juce::Colours::white.withAlpha(0.6f));
+            g.fillRect(getPlayheadBounds(c, playheads[c]));
+        }
+    }
+
+    // Adjust the blue ball
+    g.setColour(juce::Colours::darkgrey);
+    g.fillEllipse(getBallBounds());
+}
+
+// The toolbar, quadrant lines and file names only change when the files or the
+// size do, so they're drawn once into an image and paint just copies it.
+// Returns true if it had to be redrawn.
+bool SpecterAudioProcessorEditor::updateBackground()
+{
+    const auto& audioFilesFromProcessor = audioProcessor.getAudioFiles();
+    const bool scanning = audioProcessor.isScanningLibrary();
+
+    juce::Array<juce::File> files;
+    for (int i = 0; i < juce::jmin(4, audioFilesFromProcessor.size()); ++i)
+        files.add(audioFilesFromProcessor[i]);
 
-    // Fetch the audio files from the processor
-    const auto& audioFilesFromProcessor = processor->getAudioFiles();
+    const auto status = scanning ? "Scanning... " + juce::String(audioFilesFromProcessor.size()) + " files" : juce::String();
+    const auto scale = juce::Component::getApproximateScaleFactorForComponent(this);
+    const auto width = juce::roundToInt(getWidth() * scale), height = juce::roundToInt(getHeight() * scale);
+
+    if (background.isValid() && background.getWidth() == width && background.getHeight() == height
+         && files == backgroundFiles && status == backgroundStatus && ! thumbnailsChanged)
+        return false;
+
+    // New files get new overviews, which arrive through changeListenerCallback
+    if (files != backgroundFiles)
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+            thumbnails[c]->setSource(c < files.size() ? new juce::FileInputSource(files[c]) : nullptr);
+
+    backgroundFiles = files;
+    backgroundStatus = status;
+    thumbnailsChanged = false;
+    background = juce::Image(juce::Image::RGB, juce::jmax(1, width), juce::jmax(1, height), false);
+
+    juce::Graphics g(background);
+    g.addTransform(juce::AffineTransform::scale(scale));
     g.fillAll(juce::Colours::black);  
     
     // Draw the toolbar
@@ -304,22 +389,113 @@ void SpecterAudioProcessorEditor::paint(juce::Graphics& g)
     int horizontalLineY = (getHeight() - toolbarHeight) * 0.5 + toolbarHeight;
     g.drawLine(0, horizontalLineY, getWidth(), horizontalLineY, 2.0f);
 
-    // Adjust the blue ball
-    g.setColour(juce::Colours::darkgrey);
-        g.fillEllipse(ballPosition.x - 15, ballPosition.y - 15, 30, 30);
-    
+    // Each quadrant's waveform, behind its name
+    g.setColour(juce::Colours::white.withAlpha(0.2f));
+    for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+        if (thumbnails[c]->getTotalLength() > 0.0)
+            thumbnails[c]->drawChannels(g, getThumbnailBounds(c).toNearestInt(), 0.0, thumbnails[c]->getTotalLength(), 1.0f);
+
     // Display the file names
-    if (audioFilesFromProcessor.size() >= 4)
+    if (files.size() >= 4)
     {
         g.setColour(juce::Colours::white);
-        g.drawText(audioFilesFromProcessor[0].getFileName(), 10, getHeight() * 0.25, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
-        g.drawText(audioFilesFromProcessor[1].getFileName(), getWidth() * 0.5 + 10, getHeight() * 0.25, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
-        g.drawText(audioFilesFromProcessor[2].getFileName(), 10, getHeight() * 0.75, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
-        g.drawText(audioFilesFromProcessor[3].getFileName(), getWidth() * 0.5 + 10, getHeight() * 0.75, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
+        g.drawText(files[0].getFileName(), 10, getHeight() * 0.25, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
+        g.drawText(files[1].getFileName(), getWidth() * 0.5 + 10, getHeight() * 0.25, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
+        g.drawText(files[2].getFileName(), 10, getHeight() * 0.75, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
+        g.drawText(files[3].getFileName(), getWidth() * 0.5 + 10, getHeight() * 0.75, getWidth() * 0.5 - 20, 20, juce::Justification::centred);
+    }
+
+    if (status.isNotEmpty())
+    {
+        g.setColour(juce::Colours::lightgrey);
+        g.drawText(status, getWidth() - 170, toolbarHeight + 5, 160, 20, juce::Justification::centredRight);
+    }
+
+    return true;
+}
+
+
+// A thumbnail has read more of its file
+void SpecterAudioProcessorEditor::changeListenerCallback(juce::ChangeBroadcaster* source)
+{
+    juce::ignoreUnused(source);
+    thumbnailsChanged = true;
+
+    if (updateBackground())
+        repaint();
+}
+
+juce::Rectangle<float> SpecterAudioProcessorEditor::getQuadrantBounds(int corner) const
+{
+    const float toolbarHeight = 50.0f;
+    const auto width = getWidth() * 0.5f, height = (getHeight() - toolbarHeight) * 0.5f;
+    return { (corner % 2) * width, toolbarHeight + (corner / 2) * height, width, height };
+}
+
+juce::Rectangle<float> SpecterAudioProcessorEditor::getThumbnailBounds(int corner) const
+{
+    return getQuadrantBounds(corner).reduced(20.0f, 30.0f);
+}
+
+// A thin bar up the outer edge of the quadrant
+juce::Rectangle<float> SpecterAudioProcessorEditor::getMeterBounds(int corner) const
+{
+    const auto quadrant = getQuadrantBounds(corner).reduced(6.0f, 10.0f);
+    return corner % 2 == 0 ? quadrant.withWidth(4.0f) : quadrant.withLeft(quadrant.getRight() - 4.0f);
+}
+
+juce::Rectangle<int> SpecterAudioProcessorEditor::getPlayheadBounds(int corner, float playhead) const
+{
+    const auto area = getThumbnailBounds(corner);
+    return juce::Rectangle<float>(area.getX() + area.getWidth() * playhead - 1.0f, area.getY(), 2.0f, area.getHeight())
+               .getSmallestIntegerContainer();
+}
+
+// Vblank. Picks up the levels and playheads the processor has sent since the
+// last frame, and repaints just the meters and playhead lines that moved.
+void SpecterAudioProcessorEditor::updateMeters()
+{
+    const auto now = juce::Time::getMillisecondCounterHiRes();
+    const auto elapsedSeconds = juce::jlimit(0.0, 0.1, (now - lastMeterTime) * 0.001);
+    lastMeterTime = now;
+
+    CornerMeterFrame frame;
+    const bool hasFrame = audioProcessor.pullCornerMeters(frame);
+
+    for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+    {
+        // -60 dB to 0 dB up the bar, falling back at 30 dB a second
+        const auto fallen = meterLevels[c] - (float) elapsedSeconds * 0.5f;
+        const auto level = hasFrame ? juce::jmap(juce::Decibels::gainToDecibels(frame.peak[c], -60.0f), -60.0f, 0.0f, 0.0f, 1.0f) : 0.0f;
+        const auto newLevel = juce::jlimit(0.0f, 1.0f, juce::jmax(fallen, level));
+
+        if (newLevel != meterLevels[c])
+        {
+            meterLevels[c] = newLevel;
+            repaint(getMeterBounds(c).getSmallestIntegerContainer());
+        }
+
+        const auto newPlayhead = hasFrame ? frame.playhead[c] : playheads[c];
+
+        if (newPlayhead != playheads[c])
+        {
+            if (playheads[c] >= 0.0f)
+                repaint(getPlayheadBounds(c, playheads[c]));
+
+            playheads[c] = newPlayhead;
+
+            if (playheads[c] >= 0.0f)
+                repaint(getPlayheadBounds(c, playheads[c]));
+        }
     }
-    
 }
 
+void SpecterAudioProcessorEditor::updateDiceMatchButton()
+{
+    const auto match = static_cast<int>(audioProcessor.apvts.getRawParameterValue("diceMatch")->load());
+    diceMatchButton.setButtonText(juce::String("AKB").substring(match, match + 1));
+    diceMatchButton.setTooltip(audioProcessor.apvts.getParameter("diceMatch")->getCurrentValueAsText());
+}
 
 void SpecterAudioProcessorEditor::shuffleAudioFiles()
 {
@@ -344,15 +520,18 @@ void SpecterAudioProcessorEditor::resized()
     
     // Place the diceButton to the right of the folderButton, with the defined spacing
     diceButton.setBounds(folderButton.getRight() + buttonSpacing, buttonYPosition, 60, 30);
-    rndMixButton.setBounds(diceButton.getRight() + buttonSpacing, buttonYPosition, 60, 30);
+    diceMatchButton.setBounds(diceButton.getRight() + 2, buttonYPosition, 20, 30);
+    rndMixButton.setBounds(diceMatchButton.getRight() + buttonSpacing, buttonYPosition, 60, 30);
     stopButton.setBounds(rndMixButton.getRight() + buttonSpacing, buttonYPosition, 40, 20);
-    timerHzSlider.setBounds(stopButton.getRight() + buttonSpacing, buttonYPosition, 80, 20);
+    rndMixTimeSlider.setBounds(stopButton.getRight() + buttonSpacing, buttonYPosition, 80, 20);
     int buttonYPosition2 = 3; 
-    filterButton.setBounds(timerHzSlider.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
+    filterButton.setBounds(rndMixTimeSlider.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
     reverbButton.setBounds(filterButton.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
     granularButton.setBounds(reverbButton.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
     oscillatorButton.setBounds(granularButton.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
-    loopButton.setBounds(oscillatorButton.getRight() + buttonSpacing, buttonYPosition, 60, 20);
+    cornerFilterButton.setBounds(oscillatorButton.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
+    spectralButton.setBounds(cornerFilterButton.getRight() + buttonSpacing, buttonYPosition2, 20, 18);
+    loopButton.setBounds(spectralButton.getRight() + buttonSpacing, buttonYPosition, 60, 20);
 
     // This will position the second row of buttons just below the first row, with a small vertical spacing
     int secondRowYPosition = buttonYPosition + 15; // 5 is the vertical spacing between the rows
@@ -362,25 +541,46 @@ void SpecterAudioProcessorEditor::resized()
     secondRowButton2.setBounds(reverbButton.getX(), secondRowYPosition, 20, 18);
     secondRowButton3.setBounds(granularButton.getX(), secondRowYPosition, 20, 18);
     secondRowButton4.setBounds(oscillatorButton.getX(), secondRowYPosition, 20, 18);
+    cornerFilterOffButton.setBounds(cornerFilterButton.getX(), secondRowYPosition, 20, 18);
+    spectralOffButton.setBounds(spectralButton.getX(), secondRowYPosition, 20, 18);
+    perfButton.setBounds(getWidth() - 30, buttonYPosition, 20, 20);
+    perfOverlay.setBounds(getWidth() - 250, 60, 240, 230);
+
+    background = {};
 }
 
 //=====
 //Joystick movement:
 
-void SpecterAudioProcessorEditor::computeMixLevels(float& topLeft, float& topRight, float& bottomLeft, float& bottomRight)
+// Where the centre of the ball can go: the pad below the toolbar, less the ball's radius
+juce::Rectangle<float> SpecterAudioProcessorEditor::getBallTravelArea() const
 {
-    float x = ballPosition.x / getWidth();
-    float y = ballPosition.y / getHeight();
+    return juce::Rectangle<float>(15.0f, 50.0f + 15.0f, getWidth() - 30.0f, getHeight() - 50.0f - 30.0f);
+}
 
-    topLeft = (1 - x) * (1 - y);
-    topRight = x * (1 - y);
-    bottomLeft = (1 - x) * y;
-    bottomRight = x * y;
-    
-     if (auto* processor = dynamic_cast<SpecterAudioProcessor*>(getAudioProcessor()))
-    {
-        processor->setMixLevels(topLeft, topRight, bottomLeft, bottomRight);
-    }
+juce::Rectangle<float> SpecterAudioProcessorEditor::getBallBounds() const
+{
+    return juce::Rectangle<float>(30.0f, 30.0f).withCentre(ballPosition);
+}
+
+// Only the ball's old and new places are repainted
+void SpecterAudioProcessorEditor::moveBallTo(juce::Point<float> newPosition)
+{
+    if (newPosition == ballPosition)
+        return;
+
+    const auto oldBounds = getBallBounds();
+    ballPosition = newPosition;
+    repaint(oldBounds.getUnion(getBallBounds()).expanded(1.0f).getSmallestIntegerContainer());
+}
+
+void SpecterAudioProcessorEditor::publishMixPosition()
+{
+    // The ball's position relative to where it can travel, so every corner can
+    // be reached. The processor turns this into the four corner levels.
+    const auto area = getBallTravelArea();
+    audioProcessor.setMixPosition((ballPosition.x - area.getX()) / area.getWidth(),
+                                  (ballPosition.y - area.getY()) / area.getHeight());
 }
 
 
@@ -391,6 +591,10 @@ void SpecterAudioProcessorEditor::mouseDown(const juce::MouseEvent& e)
     if (distance <= 15.0f) // 15.0f is the ball's radius
     {
         isDragging = true;
+
+        // Grabbing the ball takes it off the Rnd Mix path
+        if (audioProcessor.apvts.getRawParameterValue("rndMixButton")->load() >= 0.5f)
+            audioProcessor.stopRandomMix();
     }
 }
 
@@ -402,72 +606,51 @@ void SpecterAudioProcessorEditor::mouseUp(const juce::MouseEvent& event)
 void SpecterAudioProcessorEditor::mouseDrag(const juce::MouseEvent& event)
 {
     if (isDragging)
-        
     {
-        ballPosition = event.position;
-    // Boundary checks
-    if (ballPosition.x < 15) ballPosition.x = 15;
-    if (ballPosition.x > getWidth() - 15) ballPosition.x = getWidth() - 15;
-    if (ballPosition.y < 15 + 50) ballPosition.y = 15 + 50;  // 50 is the toolbar height
-    if (ballPosition.y > getHeight() - 15) ballPosition.y = getHeight() - 15;
-        
-        float topLeft, topRight, bottomLeft, bottomRight;
-        computeMixLevels(topLeft, topRight, bottomLeft, bottomRight);
-        audioProcessor.setMixLevels(topLeft, topRight, bottomLeft, bottomRight);
-        audioProcessor.ballPosX.store(ballPosition.x / getWidth());
-        audioProcessor.ballPosY.store(ballPosition.y / getHeight());
-    DBG("Mix Levels: " + juce::String(topLeft) + ", " + juce::String(topRight) + ", " + juce::String(bottomLeft) + ", " + juce::String(bottomRight));
-    repaint();
-
-        repaint();  // Redraw with new ball position
+        moveBallTo(getBallTravelArea().getConstrainedPoint(event.position));
+        publishMixPosition();
     }
 }
 
 void SpecterAudioProcessorEditor::timerCallback()
 {
-    if (shouldMoveBall) {
-        // Calculate the vector from the current ball position to the target point
-        juce::Point<float> direction = points[currentPointIndex] - ballPosition;
-
-        // Check if we are close enough to the target point to snap to it
-        const float snapThreshold = 0.5f;
-        if (direction.getDistanceFromOrigin() < snapThreshold) {
-            ballPosition = points[currentPointIndex]; // Snap to target point
-            
-
-            // Increment the current point index and wrap it around if it exceeds the number of points
-            currentPointIndex = (currentPointIndex + 1) % 4;
-            
-        } else {
-            // Normalize the direction vector to a unit vector
-            direction = direction / direction.getDistanceFromOrigin();
-
-            // Move the ball by a small step towards the target point
-            const float stepSize = 1.0f;
-            ballPosition += direction * stepSize;
-        
-        // Once the ball reaches the point, update the processor with the new position
-        audioProcessor.ballPosX.store(ballPosition.x / getWidth());
-        audioProcessor.ballPosY.store((ballPosition.y - 50) / (getHeight() - 50));
+    // Files arrive from the library scanner in batches
+    const auto numFiles = audioProcessor.getAudioFiles().size();
 
-        }
+    if (numFiles != lastNumFiles)
+    {
+        lastNumFiles = numFiles;
+        diceButton.setEnabled(numFiles >= 4);
+    }
 
-        // Update the mix levels based on new ball position
-        float topLeft, topRight, bottomLeft, bottomRight;
-        computeMixLevels(topLeft, topRight, bottomLeft, bottomRight);
-        audioProcessor.setMixLevels(topLeft, topRight, bottomLeft, bottomRight);
+    // The host may have restored a session or moved the automation
+    loopButton.setToggleState(audioProcessor.getLooping(), juce::dontSendNotification);
 
-        // Repaint to show the ball's new position.
+    if (! rndMixTimeSlider.isMouseButtonDown())
+        rndMixTimeSlider.setValue(audioProcessor.apvts.getRawParameterValue("rndMixTime")->load(), juce::dontSendNotification);
+
+    if (updateBackground())
         repaint();
-    }
-    
-    
+}
+
+// Called once per display refresh, so the ball costs one small repaint a frame
+// however fast the mix is moving
+void SpecterAudioProcessorEditor::onVBlank()
+{
+    updateMeters();
+
+    if (isDragging)
+        return;
+
+    // Wherever the processor has the mix, which Rnd Mix moves on the audio thread
+    const auto position = audioProcessor.getMixPosition();
+    moveBallTo(getBallTravelArea().getRelativePoint(position.x, position.y));
 }
 
 void SpecterAudioProcessorEditor::sliderValueChanged(juce::Slider* slider)
 {
-    if (slider == &timerHzSlider)
+    if (slider == &rndMixTimeSlider)
     {
-        startTimerHz(timerHzSlider.getValue());
+        audioProcessor.setParameterValue("rndMixTime", (float) rndMixTimeSlider.getValue());
     }
 }
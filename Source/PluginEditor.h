@@ -10,12 +10,33 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "PerfOverlay.h"
+
+// Set to 1 to draw the editor through an OpenGL context
+#ifndef SPECTER_USE_OPENGL
+ #define SPECTER_USE_OPENGL 0
+#endif
+
+#if SPECTER_USE_OPENGL && ! JUCE_MODULE_AVAILABLE_juce_opengl
+ #error "SPECTER_USE_OPENGL needs the juce_opengl module"
+#endif
+
+// Waveform overviews, shared by every open editor so a file is only read once.
+// The cache builds them on its own thread.
+struct SharedThumbnailCache
+{
+    SharedThumbnailCache() { formatManager.registerBasicFormats(); }
+
+    juce::AudioFormatManager formatManager;
+    juce::AudioThumbnailCache cache { 64 };
+};
 
 //==============================================================================
 /**
 */
 class SpecterAudioProcessorEditor  : 
-public juce::AudioProcessorEditor, public juce::Button::Listener, public juce::Slider::Listener, public juce::Timer
+public juce::AudioProcessorEditor, public juce::Button::Listener, public juce::Slider::Listener, public juce::Timer,
+private juce::ChangeListener
 {
 public:
     explicit SpecterAudioProcessorEditor (SpecterAudioProcessor&);
@@ -34,7 +55,11 @@ private:
     // access the processor object that created it.
     SpecterAudioProcessor& audioProcessor;
      juce::TextButton folderButton; // Button to select folder
+     std::unique_ptr<juce::FileChooser> folderChooser; // Kept alive while it's open
+     int lastNumFiles = -1;
      juce::TextButton diceButton;   // Button to randomly select files
+     juce::TextButton diceMatchButton; // Cycles what Dice matches the files on
+     void updateDiceMatchButton();
      juce::Label label1, label2, label3, label4;
      juce::Array<juce::String> fileNames;
      juce::Array<juce::File> audioFiles;
@@ -42,10 +67,7 @@ private:
      void shuffleAudioFiles();
      juce::ToggleButton loopButton;
      juce::TextButton rndMixButton;
-     bool shouldMoveBall = false;
-     int currentPointIndex = 0; // Declare a variable to keep track of the current point
-     juce::Point<float> points[4]; // Declare an array to hold the points
-     juce::Slider timerHzSlider;
+     juce::Slider rndMixTimeSlider; // Seconds from one Rnd Mix waypoint to the next
      juce::TextButton stopButton;
      juce::TextButton filterButton;
      juce::TextButton reverbButton;
@@ -58,8 +80,44 @@ private:
 
      juce::TextButton granularButton;
      juce::TextButton oscillatorButton;
+     juce::TextButton cornerFilterButton;    // Gives every corner its own random filter
+     juce::TextButton cornerFilterOffButton;
+     juce::TextButton spectralButton;        // Morphs the corners' spectra instead of crossfading them
+     juce::TextButton spectralOffButton;
+     juce::TextButton perfButton;            // Shows and hides the performance overlay
+     PerfOverlay perfOverlay { audioProcessor };
      bool isDragging =false;
-     void computeMixLevels(float& topLeft, float& topRight, float& bottomLeft, float& bottomRight);
+     void publishMixPosition();
+     juce::Rectangle<float> getBallTravelArea() const;
+     juce::Rectangle<float> getBallBounds() const;
+     void moveBallTo(juce::Point<float> newPosition);
+
+     juce::Image background;        // Everything but the ball, meters and playheads, at the display's scale
+     juce::Array<juce::File> backgroundFiles;
+     juce::String backgroundStatus;
+     bool thumbnailsChanged = false;
+     bool updateBackground();
+     void changeListenerCallback(juce::ChangeBroadcaster* source) override;
+
+     juce::SharedResourcePointer<SharedThumbnailCache> thumbnailCache;
+     std::unique_ptr<juce::AudioThumbnail> thumbnails[EngineSnapshot::numCorners];
+
+     // Quadrant c is corner c: left to right, then top to bottom
+     juce::Rectangle<float> getQuadrantBounds(int corner) const;
+     juce::Rectangle<float> getThumbnailBounds(int corner) const;
+     juce::Rectangle<float> getMeterBounds(int corner) const;
+     juce::Rectangle<int> getPlayheadBounds(int corner, float playhead) const;
+     float meterLevels[EngineSnapshot::numCorners] = {}; // As drawn, 0 to 1 of the meter's height
+     float playheads[EngineSnapshot::numCorners] = { -1.0f, -1.0f, -1.0f, -1.0f };
+     double lastMeterTime = 0.0;
+     void updateMeters();
+
+     void onVBlank();
+     juce::VBlankAttachment vBlankAttachment { this, [this] { onVBlank(); } };
+
+    #if SPECTER_USE_OPENGL
+     juce::OpenGLContext openGLContext;
+    #endif
      void mouseDown(const juce::MouseEvent& e) override;
      void mouseDrag(const juce::MouseEvent& e) override;
      void mouseUp(const juce::MouseEvent& e) override;
@@ -11,7 +11,20 @@
 #include "Reverb.h"
 #include "Filter.h"
 #include "Oscillate.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <random>
+
+namespace
+{
+    // Ramp time for the XY pad, long enough to hide the editor's timer steps
+    constexpr double mixSmoothingSeconds = 0.02;
+
+    // The weights are refreshed this often while the pad is moving, and
+    // ramped linearly in between
+    constexpr int mixRampLength = 32;
+}
 
 //==============================================================================
 SpecterAudioProcessor::SpecterAudioProcessor()
@@ -24,12 +37,81 @@ SpecterAudioProcessor::SpecterAudioProcessor()
 #endif
                       ),
       apvts(*this, nullptr, "Parameters", createParameterLayout()),
+      samplePool(formatManager, [this] (const juce::Array<SampleData::Ptr>& samples)
+      {
+          // Called on the pool's thread once every requested file is decoded.
+          // Built and published under the lock, so prepareToPlay either sees
+          // this snapshot and prepares it again, or has finished before it starts.
+          const juce::ScopedLock sl(preparedSpecLock);
+          engineSnapshots.publish(createSnapshot(samples));
+          ++numSetsLoaded;
+      }),
       isLooping(true)
 {
-    // Constructor body remains empty as parameters are set up in the initializer list
+    reverbEnabledParam = apvts.getRawParameterValue("reverbButton");
+    filterEnabledParam = apvts.getRawParameterValue("filterButton");
+    oscillatorEnabledParam = apvts.getRawParameterValue("oscillatorButton");
+    polyphonyParam = apvts.getRawParameterValue("polyphony");
+    attackParam = apvts.getRawParameterValue("attack");
+    decayParam = apvts.getRawParameterValue("decay");
+    sustainParam = apvts.getRawParameterValue("sustain");
+    releaseParam = apvts.getRawParameterValue("release");
+    interpolationParam = apvts.getRawParameterValue("interpolation");
+    reverbRoomSizeParam = apvts.getRawParameterValue("reverbRoomSize");
+    reverbDampingParam = apvts.getRawParameterValue("reverbDamping");
+    reverbWetLevelParam = apvts.getRawParameterValue("reverbWetLevel");
+    reverbDryLevelParam = apvts.getRawParameterValue("reverbDryLevel");
+    reverbWidthParam = apvts.getRawParameterValue("reverbWidth");
+    reverbFreezeParam = apvts.getRawParameterValue("reverbFreeze");
+    filterModeParam = apvts.getRawParameterValue("filterMode");
+    filterCutoffParam = apvts.getRawParameterValue("filterCutoff");
+    filterResonanceParam = apvts.getRawParameterValue("filterResonance");
+    cornerFilterEnabledParam = apvts.getRawParameterValue("cornerFilterButton");
+    for (int corner = 0; corner < CornerFilterBank::numCorners; ++corner)
+    {
+        const auto id = "corner" + juce::String(corner + 1);
+        cornerFilterParams[corner].mode = apvts.getRawParameterValue(id + "FilterMode");
+        cornerFilterParams[corner].cutoff = apvts.getRawParameterValue(id + "FilterCutoff");
+        cornerFilterParams[corner].resonance = apvts.getRawParameterValue(id + "FilterResonance");
+        cornerFilterParams[corner].drive = apvts.getRawParameterValue(id + "Drive");
+    }
+    granularEnabledParam = apvts.getRawParameterValue("granularButton");
+    spectralEnabledParam = apvts.getRawParameterValue("spectralButton");
+    diceMatchParam = apvts.getRawParameterValue("diceMatch");
+    normalizeLoudnessParam = apvts.getRawParameterValue("normalizeLoudness");
+    randomMixEnabledParam = apvts.getRawParameterValue("rndMixButton");
+    randomMixTimeParam = apvts.getRawParameterValue("rndMixTime");
+    randomMixSyncParam = apvts.getRawParameterValue("rndMixSync");
+    randomMixDivisionParam = apvts.getRawParameterValue("rndMixDivision");
+    randomMixShapeParam = apvts.getRawParameterValue("rndMixShape");
+    grainDensityParam = apvts.getRawParameterValue("grainDensity");
+    grainSizeParam = apvts.getRawParameterValue("grainSize");
+    grainJitterParam = apvts.getRawParameterValue("grainJitter");
+    grainSpreadParam = apvts.getRawParameterValue("grainSpread");
+    oscillatorFrequencyParam = apvts.getRawParameterValue("oscillatorFrequency");
+    oscillatorZoneLengthParam = apvts.getRawParameterValue("oscillatorZoneLength");
+    oscillatorOverlapParam = apvts.getRawParameterValue("oscillatorOverlap");
+
+    formatManager.registerBasicFormats();
+
+    libraryScanner.onFilesFound = [this] (const juce::Array<juce::File>& files) { addAudioFiles(files); };
+    libraryScanner.onScanFinished = [this] (int numFiles, bool)
+    {
+        redrawRestoredDicePicks();
+
+        // Fewer than four still get played
+        if (numFiles > 0 && numFiles < 4 && ! keepLoadedFiles)
+            loadFiles(audioFiles2);
+    };
+
+    readAheadThread.startThread(juce::Thread::Priority::high);
+    setMixPosition(0.5f, 0.5f);
+
+    // Old engine snapshots are freed here, on the message thread
+    startTimerHz(4);
 }
 SpecterAudioProcessor::~SpecterAudioProcessor() {
-    
+    stopTimer();
 }
 
 
@@ -128,20 +210,39 @@ bool SpecterAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 
 void SpecterAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Existing code...
-    samplesPerBlockExpected = samplesPerBlock;
-    this->currentSampleRate = sampleRate;
-    // ...
-
-    // Prepare transport sources with the current sample rate
-    for (int i = 0; i < 4; ++i) {
-        transportSource[i].prepareToPlay(samplesPerBlockExpected, currentSampleRate);
-    }
-    
-    for (int i = 0; i < 4; ++i) {
-        isTransportSourcePrepared[i] = true;
+    {
+        // The pool's thread reads these while it builds a snapshot
+        const juce::ScopedLock sl(preparedSpecLock);
+        samplesPerBlockExpected = samplesPerBlock;
+        this->currentSampleRate = sampleRate;
+
+        // Prepare the corner players with the current sample rate. The audio thread
+        // is stopped here, so the live snapshot can be touched directly.
+        engineSnapshots.forEachPrepared([this] (EngineSnapshot& snapshot)
+        {
+            for (auto& voicePlayers : snapshot.players)
+                for (auto& player : voicePlayers)
+                    player.prepare(samplesPerBlockExpected, currentSampleRate, getTotalNumOutputChannels());
+        });
     }
 
+    voiceEngine.prepare(currentSampleRate, samplesPerBlockExpected, getTotalNumOutputChannels());
+    renderWorkers.configure(requestedRenderWorkers.load(), samplesPerBlockExpected / currentSampleRate);
+    granularEngine.prepare(currentSampleRate, samplesPerBlockExpected, getTotalNumOutputChannels());
+    spectralMorph.prepare(currentSampleRate);
+
+    for (auto& cornerBuffer : cornerBuffers)
+        cornerBuffer.setSize(getTotalNumOutputChannels(), samplesPerBlockExpected);
+
+    for (auto& oscillator : cornerOscillators)
+        oscillator.prepare(currentSampleRate);
+
+    const auto position = getMixPosition();
+    smoothedMixX.reset(currentSampleRate, mixSmoothingSeconds);
+    smoothedMixY.reset(currentSampleRate, mixSmoothingSeconds);
+    smoothedMixX.setCurrentAndTargetValue(position.x);
+    smoothedMixY.setCurrentAndTargetValue(position.y);
+
     // Prepare the reverb effect
     juce::dsp::ProcessSpec spec;
     spec.sampleRate = currentSampleRate;
@@ -152,6 +253,15 @@ void SpecterAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBloc
     reverbEffect.reset();
     lowPassFilterEffect.prepare(spec);
     lowPassFilterEffect.reset();
+    cornerFilterBank.prepare(currentSampleRate, samplesPerBlockExpected, getTotalNumOutputChannels());
+    cornerFilterBank.reset();
+
+    // The effects were just rebuilt at their defaults, so apply everything again
+    appliedReverbSettings.fill(std::numeric_limits<float>::quiet_NaN());
+    appliedFilterSettings.fill(std::numeric_limits<float>::quiet_NaN());
+    appliedOscillatorSettings.fill(std::numeric_limits<float>::quiet_NaN());
+    appliedCornerFilterSettings.fill(std::numeric_limits<float>::quiet_NaN());
+    updateEffectParameters();
 }
 
 void SpecterAudioProcessor::releaseResources()
@@ -164,56 +274,138 @@ void SpecterAudioProcessor::releaseResources()
 
 void SpecterAudioProcessor::loadFiles(const juce::Array<juce::File>& files)
 {
-    // Lock the critical section
-    const juce::ScopedLock myScopedLock(lock);
+    // The pool decodes anything it does not already hold on its own thread,
+    // builds the complete new set of sources and hands it to the audio thread
+    // in one step. The audio thread keeps playing the old set until then.
+    currentFiles = files;
+    publishSessionFiles();
+    analysisIndex->analyseInBackground(files); // Files dropped in from outside the library too
+    updateLoadMode();
+    updateSampleModeData();
+    samplePool.requestSet(files);
+    engineSnapshots.collectGarbage();
+}
 
-    // Clear existing sources and transport sources to ensure we do not have dangling pointers
-    for (auto& source : transportSource)
+std::unique_ptr<EngineSnapshot> SpecterAudioProcessor::createSnapshot(const juce::Array<SampleData::Ptr>& samples)
+{
+    auto snapshot = std::make_unique<EngineSnapshot>();
+
+    for (int i = 0; i < EngineSnapshot::numCorners; ++i)
     {
-        source.setSource(nullptr);  // Disconnect the source before resetting
-        source.releaseResources();
+        if (i < samples.size())
+        {
+            if (auto sample = samples[i])
+            {
+                snapshot->files.add(sample->file);
+                snapshot->sample[i] = sample;
+
+                // Usually analysed in the background already. If not, the corner
+                // plays at unity until the timer finds the result.
+                SampleFeatures features;
+
+                if (analysisIndex->getFeatures(sample->file, features))
+                {
+                    sample->setNormalizationGain(features.getNormalizationGain());
+                }
+                else
+                {
+                    const juce::ScopedLock sl(samplesAwaitingGainLock);
+                    samplesAwaitingGain.addIfNotAlreadyThere(sample);
+                }
+
+                // A cursor per voice, so every voice can play this corner independently
+                for (auto& voicePlayers : snapshot->players)
+                {
+                    auto& player = voicePlayers[i];
+                    player.source = sample->createSource(playbackContext);
+                    player.fileSampleRate = sample->sampleRate;
+                    player.prepare(samplesPerBlockExpected, currentSampleRate, getTotalNumOutputChannels());
+                }
+            }
+        }
     }
 
-    for (auto& readerSrc : readerSource)
+    return snapshot;
+}
+
+void SpecterAudioProcessor::timerCallback()
+{
+    engineSnapshots.collectGarbage();
+
+    // A session the host restored from another thread
+    juce::ValueTree session;
     {
-        readerSrc.reset();  // Reset the reader source, which will delete the AudioFormatReader if it's the owner
+        const juce::ScopedLock sl(pendingSessionLock);
+        std::swap(session, pendingSession);
     }
 
-    formatManager.registerBasicFormats();
+    if (session.isValid())
+        restoreSession(session);
 
-    for (int i = 0; i < 4; ++i)
+    updateSampleModeData();
+    applyNormalizationGains();
+    updateDiceCandidates();
+
+    // Reload what is playing so a change of load mode is heard straight away
+    if (updateLoadMode() && ! currentFiles.isEmpty())
+        loadFiles(currentFiles);
+}
+
+// The grains' audio and the spectral frames are only built for the playing
+// set once their mode is switched on
+void SpecterAudioProcessor::updateSampleModeData()
+{
+    samplePool.setWantsGrainAudio(granularEnabledParam->load() >= 0.5f);
+    samplePool.setWantsSpectralFrames(spectralEnabledParam->load() >= 0.5f);
+}
+
+// Gives the samples that were loaded before the analysis index had measured
+// them their gain, now that it has. Whatever can't be analysed stays at unity.
+void SpecterAudioProcessor::applyNormalizationGains()
+{
+    const juce::ScopedLock sl(samplesAwaitingGainLock);
+
+    for (int i = samplesAwaitingGain.size(); --i >= 0;)
     {
-        if (i < files.size())
-        {
-            std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(files[i]));
-            if (reader.get() != nullptr)
-            {
-                // Get the sample rate from the reader before releasing it
-                auto fileSampleRate = reader->sampleRate;
-
-                readerSource[i].reset(new juce::AudioFormatReaderSource(reader.release(), true));
-                transportSource[i].setSource(readerSource[i].get(),
-                                            0,                    // buffer size
-                                            nullptr,              // use the default buffer
-                                            fileSampleRate);      // use the file's sample rate
-                transportSource[i]
-                .prepareToPlay(samplesPerBlockExpected, currentSampleRate);
-            }
-        }
+        SampleFeatures features;
+
+        if (analysisIndex->getFeatures(samplesAwaitingGain[i]->file, features))
+            samplesAwaitingGain[i]->setNormalizationGain(features.getNormalizationGain());
+        else if (analysisIndex->getNumPending() > 0)
+            continue;
+
+        samplesAwaitingGain.remove(i);
     }
 }
+
+// Hands the loadMode parameter to the pool. Returns true if it changed.
+bool SpecterAudioProcessor::updateLoadMode()
+{
+    const int mode = static_cast<int>(apvts.getRawParameterValue("loadMode")->load());
+
+    if (mode == appliedLoadMode)
+        return false;
+
+    appliedLoadMode = mode;
+    samplePool.setLoadMode(mode == 1 ? SamplePool::LoadMode::memoryMapped
+                         : mode == 2 ? SamplePool::LoadMode::streamed
+                                     : SamplePool::LoadMode::decoded);
+    return true;
+}
 //=================
 
 void SpecterAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    
-    juce::ScopedLock myScopedLock(lock); // Lock the critical section
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     int numSamples = buffer.getNumSamples();  // Store the result here
+    perfCounters.beginBlock();
 
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, numSamples);  // Use the stored result
+
+    // Picks up a newly loaded set of sources, if there is one. Never blocks.
+    auto* engine = engineSnapshots.acquire();
     
     for (int channel = 0; channel < totalNumInputChannels; ++channel)
     {
@@ -222,100 +414,379 @@ void SpecterAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce
         for (int sample = 0; sample < numSamples; ++sample)  // And here
             channelData[sample] *= 0.5f;
     }
-    juce::MidiMessage message;
-        int samplePosition; // This will be used to know the position of the MIDI message in the buffer
+    // A new set of files. What is sounding is released and plays out from the
+    // set it started in, so nothing is cut off mid-sample; that set is kept
+    // until its last voice and grain have finished.
+    if (engine != voicesSnapshot)
+    {
+        voiceEngine.allNotesOff();
+        voicesSnapshot = engine;
+    }
 
-        // Use a for loop to iterate over the midi messages in the buffer
-         for (const auto metadata : midiMessages)
-        {
-            const auto& message = metadata.getMessage();
-            if (message.isNoteOn())
-            {
-                int noteNumber = message.getNoteNumber();
-                double speed = std::pow(2.0, (noteNumber - 60) / 12.0);
+    engineSnapshots.retireUnused([this] (const EngineSnapshot& snapshot)
+    {
+        return voiceEngine.isUsing(snapshot) || granularEngine.isUsing(snapshot);
+    });
 
-                for (int i = 0; i < 4; ++i)
-                {
-                    transportSource[i].setSource(readerSource[i].get(), 0, nullptr, readerSource[i]->getAudioFormatReader()->sampleRate * speed);
-                    transportSource[i].setPosition(0.0);
-        
-                    // Assuming isTransportSourcePrepared[i] is an array of flags that indicates whether each transport source is ready
-                    if (isTransportSourcePrepared[i])
-                    {
-                        transportSource[i].start();
-                    }
-                }
-            }
-            else if (message.isNoteOff())
-            {
-                // Optionally handle note off messages
-            }
+    voiceEngine.setPolyphony(static_cast<int>(polyphonyParam->load()));
+    updateRandomMix();
+    std::fill(std::begin(meterFrame.peak), std::end(meterFrame.peak), 0.0f);
+
+    // Corner buffers are sized in prepareToPlay, so this doesn't allocate
+    for (auto& cornerBuffer : cornerBuffers)
+        cornerBuffer.setSize(totalNumOutputChannels, numSamples, false, false, true);
+
+    // Split the block at every MIDI event and at least every maxSubBlockSize
+    // samples, so notes start on the sample they were sent for and parameter
+    // changes are picked up within a sub-block, whatever the host block size.
+    const int maxSegment = juce::jmax(1, maxSubBlockSize.load(std::memory_order_relaxed));
+    auto nextEvent = midiMessages.cbegin();
+    const auto lastEvent = midiMessages.cend();
+
+    for (int segmentStart = 0; segmentStart < numSamples;)
+    {
+        for (; nextEvent != lastEvent && (*nextEvent).samplePosition <= segmentStart; ++nextEvent)
+            handleMidiEvent((*nextEvent).getMessage(), engine);
+
+        int segmentEnd = juce::jmin(numSamples, segmentStart + maxSegment);
+
+        if (nextEvent != lastEvent)
+            segmentEnd = juce::jmin(segmentEnd, (*nextEvent).samplePosition);
+
+        renderSegment(buffer, engine, segmentStart, segmentEnd - segmentStart);
+        segmentStart = segmentEnd;
+    }
+
+    // Events stamped past the end of the block still count
+    for (; nextEvent != lastEvent; ++nextEvent)
+        handleMidiEvent((*nextEvent).getMessage(), engine);
+
+    // The corner players only move when the corners are crossfaded
+    const bool playersInUse = engine != nullptr && granularEnabledParam->load() < 0.5f && spectralEnabledParam->load() < 0.5f;
+
+    if (playersInUse)
+        voiceEngine.getCornerPlayheads(*engine, meterFrame.playhead);
+    else
+        std::fill(std::begin(meterFrame.playhead), std::end(meterFrame.playhead), -1.0f);
+
+    cornerMeters.push(meterFrame);
+    perfCounters.endBlock(numSamples, currentSampleRate);
+
+    // Clear the MIDI buffer if you have processed the messages
+    midiMessages.clear();
+}
+
+void SpecterAudioProcessor::handleMidiEvent(const juce::MidiMessage& message, EngineSnapshot* engine)
+{
+    if (message.isNoteOn())
+    {
+        if (engine != nullptr)
+        {
+            // The envelope is read per note, so a change lands on the next note-on
+            voiceEngine.setEnvelope({ attackParam->load(), decayParam->load(), sustainParam->load(), releaseParam->load() });
+            voiceEngine.noteOn(*engine, message.getNoteNumber());
         }
+    }
+    else if (message.isNoteOff())
+    {
+        voiceEngine.noteOff(message.getNoteNumber());
+    }
+    else if (message.isAllNotesOff() || message.isAllSoundOff())
+    {
+        voiceEngine.allNotesOff();
+    }
+    else if (message.isPitchWheel())
+    {
+        // Two semitones either way. Only changes the voices' playback rates.
+        const auto semitones = (message.getPitchWheelValue() - 8192) / 8192.0 * 2.0;
+        pitchBend = std::pow(2.0, semitones / 12.0);
+    }
+}
 
-        // Clear the MIDI buffer if you have processed the messages
-        midiMessages.clear();
-// Temporary buffer to hold audio data from each source
-    juce::AudioBuffer<float> tempBuffer(totalNumOutputChannels, buffer.getNumSamples());
-    // Retrieve the current mix levels (assumes these are stored in your processor)
-    float mixLevels[4];
-    getMixLevels(mixLevels[0], mixLevels[1], mixLevels[2], mixLevels[3]);
-    bool oscillatorEnabled = apvts.getParameterAsValue("oscillatorButton").getValue();
+// Runs the whole chain, voices to reverb, over one stretch of the block.
+// Everything works in place on the range, so nothing is copied.
+void SpecterAudioProcessor::renderSegment(juce::AudioBuffer<float>& buffer, EngineSnapshot* engine, int startSample, int numSamples)
+{
+    updateEffectParameters();
 
-    // Only create the SampleOscillator if we're going to use it
-    SampleOscillator oscillator;
+    VoiceRenderSettings renderSettings;
+    renderSettings.looping = isLooping.load();
+    renderSettings.pitchBend = pitchBend;
+    renderSettings.interpolation = static_cast<SamplePlayer::Interpolation>(static_cast<int>(interpolationParam->load()));
 
-    // Mix the audio from each transport source into the output buffer
-    for (int i = 0; i < 4; ++i)
+    if (! randomMixActive)
+    {
+        const auto target = getMixPosition();
+        smoothedMixX.setTargetValue(target.x);
+        smoothedMixY.setTargetValue(target.y);
+    }
+
+    // Loudness normalization scales each corner's weight in the mix. A gain
+    // that arrives while a corner plays is ramped to, like a move of the ball.
+    const bool normalize = engine != nullptr && normalizeLoudnessParam->load() >= 0.5f;
+    float cornerGains[EngineSnapshot::numCorners];
+    bool gainsChanging = false;
+
+    for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+    {
+        cornerGains[c] = normalize ? engine->getNormalizationGain(c) : 1.0f;
+        gainsChanging = gainsChanging || cornerGains[c] != appliedCornerGains[c];
+    }
+
+    const auto weightsAt = [] (float x, float y, const float* gains, float* weights)
+    {
+        BilinearMix::weightsAt(x, y, weights);
+        juce::FloatVectorOperations::multiply(weights, gains, BilinearMix::numCorners);
+    };
+
+    float startWeights[BilinearMix::numCorners];
+    weightsAt(smoothedMixX.getCurrentValue(), smoothedMixY.getCurrentValue(), appliedCornerGains, startWeights);
+    std::copy(std::begin(cornerGains), std::end(cornerGains), std::begin(appliedCornerGains));
+
+    bool filteredCorners = false;
+
+    if (granularEnabledParam->load() >= 0.5f)
     {
-        if (transportSource[i].isPlaying())
+        // The voices start grains instead of playing the corners. The pad
+        // weights pick which corner each grain comes from, so there is no
+        // corner mix; the smoothing just moves on.
+        GranularEngine::Settings grainSettings;
+        grainSettings.density = grainDensityParam->load();
+        grainSettings.sizeMs = grainSizeParam->load();
+        grainSettings.jitter = grainJitterParam->load();
+        grainSettings.spread = grainSpreadParam->load();
+        grainSettings.cornerGains = cornerGains;
+
+        // Grains pick their corner by the pad alone; the gains set their level
+        BilinearMix::weightsAt(smoothedMixX.getCurrentValue(), smoothedMixY.getCurrentValue(), startWeights);
+
         {
-            tempBuffer.clear(); // Clear the temporary buffer
-            juce::AudioSourceChannelInfo info(&tempBuffer, 0, buffer.getNumSamples());
-            transportSource[i].getNextAudioBlock(info); // Fetch the audio block first
+            const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::sources);
+            voiceEngine.renderGrains(granularEngine, numSamples, startWeights, grainSettings, renderSettings);
+        }
 
-            
-            if (oscillatorEnabled) {
-                processOscillatorEffect(tempBuffer, oscillator);
-            }
+        advanceMixPosition(numSamples);
+    }
+    else if (spectralEnabledParam->load() >= 0.5f)
+    {
+        // The weights blend the corners' spectra once per hop, so they only
+        // need to be where the ball is at the start of the range
+        {
+            const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::sources);
+            voiceEngine.renderSpectral(spectralMorph, buffer, startSample, numSamples, startWeights, renderSettings);
+        }
 
-            // Assuming isLooping is a condition that you want to check
-            if (isLooping && transportSource[i].hasStreamFinished()) {
-                transportSource[i].setPosition(0); // Loop back to the start
-                transportSource[i].start(); // Start playing again
-            }
+        advanceMixPosition(numSamples);
+    }
+    else
+    {
+        // Every voice adds into the four corner buffers
+        for (auto& cornerBuffer : cornerBuffers)
+            cornerBuffer.clear(startSample, numSamples);
+
+        renderCorners(startSample, numSamples, renderSettings);
+
+        // All four corners' filters run together, one corner per vector lane
+        if (cornerFilterEnabledParam->load() >= 0.5f)
+        {
+            const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::filters);
+
+            // Whatever the filters still held from the last time they ran would
+            // come out as a burst
+            if (! cornerFilterRunning)
+                cornerFilterBank.reset();
+
+            cornerFilterBank.process(cornerBuffers, startSample, numSamples);
+            filteredCorners = true;
+        }
+
+        const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::mix);
+
+        // Each corner's meter shows what it adds to the mix
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+            meterFrame.peak[c] = juce::jmax(meterFrame.peak[c], cornerBuffers[c].getMagnitude(startSample, numSamples) * startWeights[c]);
+
+        // Weight and sum all four corners into the output in a single pass,
+        // gliding the weights towards wherever the ball is now
+        if (! randomMixActive && ! gainsChanging && ! smoothedMixX.isSmoothing() && ! smoothedMixY.isSmoothing())
+        {
+            BilinearMix::addToBuffer(buffer, cornerBuffers, startWeights, startWeights, startSample, numSamples);
+        }
+        else
+        {
+            float endWeights[BilinearMix::numCorners];
 
-            // Add the contents of the temporary buffer to the main buffer
-            for (int channel = 0; channel < totalNumOutputChannels; ++channel)
+            for (int start = 0; start < numSamples; start += mixRampLength)
             {
-                buffer.addFrom(channel, 0, tempBuffer, channel, 0, buffer.getNumSamples(), mixLevels[i]);
+                const int num = juce::jmin(mixRampLength, numSamples - start);
+                const auto position = advanceMixPosition(num);
+                weightsAt(position.x, position.y, cornerGains, endWeights);
+                BilinearMix::addToBuffer(buffer, cornerBuffers, startWeights, endWeights, startSample + start, num);
+                std::copy(std::begin(endWeights), std::end(endWeights), startWeights);
             }
         }
     }
- 
-    bool reverbEnabled = apvts.getParameterAsValue("reverbButton").getValue();
-    bool filterEnabled = apvts.getParameterAsValue("filterButton").getValue();
-    
-    if (filterEnabled)
+
+    cornerFilterRunning = filteredCorners;
+
+    // Grains already playing ring out even after granular is switched off
     {
-        lowPassFilterEffect.process(buffer);
-        
+        const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::sources);
+        granularEngine.render(buffer, startSample, numSamples);
     }
-    else
+
+    // Grains and spectra aren't kept apart by corner, so the meters share the
+    // output level out by the pad weights
+    if (granularEnabledParam->load() >= 0.5f || spectralEnabledParam->load() >= 0.5f)
     {
+        const auto outputPeak = buffer.getMagnitude(startSample, numSamples);
+
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+            meterFrame.peak[c] = juce::jmax(meterFrame.peak[c], outputPeak * startWeights[c]);
+    }
+
+    bool reverbEnabled = reverbEnabledParam->load() >= 0.5f;
+    bool filterEnabled = filterEnabledParam->load() >= 0.5f;
+
+    if (filterEnabled)
+    {
+        const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::filters);
+        lowPassFilterEffect.process(buffer, startSample, numSamples);
     }
 
     if (reverbEnabled)
     {
+        const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::reverb);
+        reverbEffect.process(buffer, startSample, numSamples);
+    }
+}
+
+// The voices and the oscillators, into the corner buffers. With render
+// workers, and enough work to make it pay, every voice's corners render as
+// separate tasks, then each corner is summed and oscillated as another.
+void SpecterAudioProcessor::renderCorners(int startSample, int numSamples, const VoiceRenderSettings& settings)
+{
+    const bool oscillate = oscillatorEnabledParam->load() >= 0.5f;
+
+    // Rough cost per output sample and channel of one voice's corner, from the benchmarks
+    const double voiceCornerNs = settings.interpolation == SamplePlayer::Interpolation::sinc   ? 12.0
+                               : settings.interpolation == SamplePlayer::Interpolation::hermite ? 3.0
+                                                                                                : 2.0;
+    const double cornerSamples = (double) numSamples * getTotalNumOutputChannels() * EngineSnapshot::numCorners;
+    const double workNs = cornerSamples * (voiceEngine.getNumActiveVoices() * voiceCornerNs + (oscillate ? 0.5 : 0.0));
+
+    const bool parallel = numSamples <= voiceEngine.getBlockSize()
+                       && renderWorkers.isWorthSplitting(workNs, voiceEngine.getNumActiveVoices() * EngineSnapshot::numCorners);
+
+    if (! parallel)
+    {
+        {
+            const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::sources);
+            voiceEngine.render(cornerBuffers, startSample, numSamples, settings);
+        }
+
+        if (oscillate)
+        {
+            const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::oscillators);
+
+            for (int i = 0; i < EngineSnapshot::numCorners; ++i)
+                processOscillatorEffect(cornerBuffers[i], cornerOscillators[i], startSample, numSamples);
+        }
+
+        return;
+    }
+
+    // Spread over the workers, the oscillators can't be timed apart from the voices
+    const PerfCounters::ScopedStage timing(perfCounters, PerfCounters::sources);
+    const int numVoices = voiceEngine.beginRender(numSamples);
+
+    renderWorkers.run(numVoices * EngineSnapshot::numCorners, [&] (int task)
+    {
+        voiceEngine.renderTask(task, numSamples, settings);
+    });
+
+    renderWorkers.run(EngineSnapshot::numCorners, [&] (int corner)
+    {
+        voiceEngine.mixCorner(corner, cornerBuffers[corner], startSample, numSamples);
 
-        reverbEffect.process(buffer);
+        if (oscillate)
+            processOscillatorEffect(cornerBuffers[corner], cornerOscillators[corner], startSample, numSamples);
+    });
 
-        // After processing, print out the buffer's first sample from channel 0 for debugging
+    voiceEngine.endRender();
+}
+
+// Hands the effect parameters to the DSP. Only what actually changed is
+// passed on, so an untouched parameter costs one atomic load per sub-block.
+void SpecterAudioProcessor::updateEffectParameters()
+{
+    const std::array<float, 6> reverbSettings { reverbRoomSizeParam->load(), reverbDampingParam->load(),
+                                                reverbWetLevelParam->load(), reverbDryLevelParam->load(),
+                                                reverbWidthParam->load(), reverbFreezeParam->load() };
+
+    if (reverbSettings != appliedReverbSettings)
+    {
+        reverbEffect.updateParameters(reverbSettings[0], reverbSettings[1], reverbSettings[2],
+                                      reverbSettings[3], reverbSettings[4], reverbSettings[5]);
+        appliedReverbSettings = reverbSettings;
     }
-    else
+
+    const std::array<float, 3> filterSettings { filterCutoffParam->load(), filterResonanceParam->load(), filterModeParam->load() };
+
+    if (filterSettings != appliedFilterSettings)
+    {
+        // The filter glides to a new cutoff and resonance on its own
+        lowPassFilterEffect.updateParameters(filterSettings[0], filterSettings[1]);
+        lowPassFilterEffect.setMode(static_cast<LowPassFilterEffect::Mode>(static_cast<int>(filterSettings[2])));
+        appliedFilterSettings = filterSettings;
+    }
+
+    std::array<float, 4 * CornerFilterBank::numCorners> cornerFilterSettings;
+
+    for (int corner = 0; corner < CornerFilterBank::numCorners; ++corner)
+    {
+        const auto& params = cornerFilterParams[corner];
+        cornerFilterSettings[(size_t) corner * 4]     = params.mode->load();
+        cornerFilterSettings[(size_t) corner * 4 + 1] = params.cutoff->load();
+        cornerFilterSettings[(size_t) corner * 4 + 2] = params.resonance->load();
+        cornerFilterSettings[(size_t) corner * 4 + 3] = params.drive->load();
+    }
+
+    if (cornerFilterSettings != appliedCornerFilterSettings)
+    {
+        for (int corner = 0; corner < CornerFilterBank::numCorners; ++corner)
+        {
+            CornerFilterBank::CornerSettings settings;
+            settings.mode = static_cast<CornerFilterBank::Mode>(static_cast<int>(cornerFilterSettings[(size_t) corner * 4]));
+            settings.cutoff = cornerFilterSettings[(size_t) corner * 4 + 1];
+            settings.resonance = cornerFilterSettings[(size_t) corner * 4 + 2];
+            settings.drive = cornerFilterSettings[(size_t) corner * 4 + 3];
+            cornerFilterBank.setCorner(corner, settings);
+        }
+
+        appliedCornerFilterSettings = cornerFilterSettings;
+    }
+
+    const std::array<float, 3> oscillatorSettings { oscillatorFrequencyParam->load(), oscillatorZoneLengthParam->load(),
+                                                    oscillatorOverlapParam->load() };
+
+    if (oscillatorSettings != appliedOscillatorSettings)
     {
-        //DBG("Bypassing Reverb"); // Debug statement
+        for (auto& oscillator : cornerOscillators)
+            oscillator.updateParameters(oscillatorSettings[0], oscillatorSettings[1], oscillatorSettings[2]);
+
+        appliedOscillatorSettings = oscillatorSettings;
     }
+}
+
+void SpecterAudioProcessor::setMaxSubBlockSize(int numSamples)
+{
+    maxSubBlockSize.store(juce::jmax(1, numSamples));
+}
 
+void SpecterAudioProcessor::setNumRenderWorkers(int numWorkers)
+{
+    requestedRenderWorkers.store(juce::jmax(0, numWorkers));
 }
 
 
@@ -333,17 +804,152 @@ juce::AudioProcessorEditor* SpecterAudioProcessor::createEditor()
 }
 
 //==============================================================================
+// The parameters plus a Session child with the files, library, ball and Rnd
+// Mix seed, as a gzipped binary ValueTree after a short header
+namespace
+{
+    constexpr int stateMagic = 0x53706331; // "Spc1"
+    constexpr int stateVersion = 1;
+}
+
 void SpecterAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    auto state = apvts.copyState();
+    const auto position = getMixPosition();
+
+    juce::ValueTree session("Session");
+
+    {
+        const juce::ScopedLock sl(pendingSessionLock);
+
+        // A session the host has just restored, but the timer hasn't applied yet
+        if (pendingSession.isValid())
+        {
+            session = pendingSession.createCopy();
+        }
+        else
+        {
+            session.setProperty("library", savedLibraryFolder.getFullPathName(), nullptr);
+            session.setProperty("diceSeed", diceSeedInUse.load(), nullptr);
+
+            for (const auto& file : savedFiles)
+                session.appendChild(juce::ValueTree("File").setProperty("path", file.getFullPathName(), nullptr), nullptr);
+        }
+    }
+
+    session.setProperty("mixX", position.x, nullptr);
+    session.setProperty("mixY", position.y, nullptr);
+    session.setProperty("looping", getLooping(), nullptr);
+    session.setProperty("rndMixSeed", randomMixSeedInUse.load(), nullptr);
+    state.appendChild(session, nullptr);
+
+    juce::MemoryOutputStream stream(destData, false);
+    stream.writeInt(stateMagic);
+    stream.writeInt(stateVersion);
+
+    juce::GZIPCompressorOutputStream compressed(stream);
+    state.writeToStream(compressed);
 }
 
+// Returns straight away. The parameters, ball and loop switch are set here;
+// the samples load on the pool's thread, with the output silent until they're
+// ready, and the library is read from its index in the background.
 void SpecterAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    juce::MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+
+    if (stream.readInt() != stateMagic || stream.readInt() > stateVersion)
+        return;
+
+    juce::GZIPDecompressorInputStream decompressed(stream);
+    auto state = juce::ValueTree::readFromStream(decompressed);
+
+    if (! state.hasType(apvts.state.getType()))
+        return;
+
+    auto session = state.getChildWithName("Session");
+    state.removeChild(session, nullptr);
+    apvts.replaceState(state);
+
+    setMixPosition(session.getProperty("mixX", 0.5f), session.getProperty("mixY", 0.5f));
+    setLooping(session.getProperty("looping", true));
+
+    // Same seed, same Rnd Mix loop
+    const auto seed = static_cast<juce::int64>(session.getProperty("rndMixSeed", 0));
+    randomMixSeedInUse.store(seed);
+
+    if (seed != 0 && randomMixEnabledParam->load() >= 0.5f)
+        randomMixSeed.store(seed);
+
+    // The files and the library belong to the message thread
+    if (juce::MessageManager::existsAndIsCurrentThread())
+    {
+        restoreSession(session);
+    }
+    else
+    {
+        const juce::ScopedLock sl(pendingSessionLock);
+        pendingSession = session;
+    }
+}
+
+// Message thread
+void SpecterAudioProcessor::restoreSession(const juce::ValueTree& session)
+{
+    juce::Array<juce::File> files;
+
+    for (int i = 0; i < session.getNumChildren(); ++i)
+        if (const juce::File file(session.getChild(i).getProperty("path").toString()); file.existsAsFile())
+            files.add(file);
+
+    if (! files.isEmpty())
+        loadFiles(files);
+
+    // The restored files stay at the front, where the editor shows them, and
+    // the rest of the library fills in behind them
+    audioFiles2 = files;
+    upcomingDicePicks.clear();
+    diceCandidates.clear();
+    diceCandidateIndices.clear();
+    libraryFolder = juce::File(session.getProperty("library").toString());
+    publishSessionFiles();
+
+    // Same seed and same library, same next Dice roll
+    restoredDiceSeed = static_cast<juce::int64>(session.getProperty("diceSeed", 0));
+    diceSeedInUse.store(restoredDiceSeed);
+
+    if (libraryFolder.isDirectory())
+    {
+        keepLoadedFiles = true;
+        libraryScanner.scan(libraryFolder); // Dice's candidates come in with the scan
+    }
+    else
+    {
+        addDiceCandidates(files);
+        redrawRestoredDicePicks();
+    }
+}
+
+// Message thread. Once the whole library is in, draws the next Dice roll
+// again from the seed the session was saved with.
+void SpecterAudioProcessor::redrawRestoredDicePicks()
+{
+    if (restoredDiceSeed == 0 || diceCandidates.size() < 4)
+        return;
+
+    diceRandom.setSeed(restoredDiceSeed);
+    restoredDiceSeed = 0;
+    upcomingDicePicks = drawDicePicks();
+    samplePool.prefetch(upcomingDicePicks);
+}
+
+// Message thread. Copies the files and library for getStateInformation, which
+// the host may call from any thread.
+void SpecterAudioProcessor::publishSessionFiles()
+{
+    const juce::ScopedLock sl(pendingSessionLock);
+    savedFiles = currentFiles;
+    savedLibraryFolder = libraryFolder;
 }
 
 //==============================================================================
@@ -357,9 +963,178 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 //Persistence:
 
 void SpecterAudioProcessor::updateAudioFiles(const juce::Array<juce::File>& newFiles) {
-    const juce::ScopedLock myScopedLock(lock); // Lock for thread safety if necessary
+    // Message thread only; the audio thread never reads this list
     audioFiles2 = newFiles;
-    // Add any additional logic you need, such as updating the playback state.
+    diceCandidates.clear();
+    diceCandidateIndices.clear();
+    addDiceCandidates(newFiles);
+
+    // Measure the whole library in the background, for Dice and the corner gains
+    analysisIndex->analyseInBackground(audioFiles2);
+
+    // Start decoding the first Dice picks for this library right away
+    upcomingDicePicks = drawDicePicks();
+    samplePool.prefetch(upcomingDicePicks);
+}
+
+void SpecterAudioProcessor::scanLibrary(const juce::File& folder, bool forceRescan)
+{
+    libraryFolder = folder;
+    publishSessionFiles();
+    keepLoadedFiles = false;
+    audioFiles2.clear();
+    diceCandidates.clear();
+    diceCandidateIndices.clear();
+    upcomingDicePicks.clear();
+    libraryScanner.scan(folder, forceRescan);
+}
+
+// Message thread, for each batch the scanner finds
+void SpecterAudioProcessor::addAudioFiles(const juce::Array<juce::File>& newFiles)
+{
+    const bool hadFour = audioFiles2.size() >= 4;
+    const bool couldDice = diceCandidates.size() >= 4;
+
+    // A restored session's files are already at the front
+    if (keepLoadedFiles)
+    {
+        for (const auto& file : newFiles)
+            if (! currentFiles.contains(file))
+                audioFiles2.add(file);
+    }
+    else
+    {
+        audioFiles2.addArray(newFiles);
+    }
+
+    // Dice picks from everything the scanner finds, restored files included,
+    // in the order it finds them
+    addDiceCandidates(newFiles);
+    analysisIndex->analyseInBackground(newFiles);
+
+    // As soon as there are four, play them and start on the Dice picks
+    if (! hadFour && audioFiles2.size() >= 4 && ! keepLoadedFiles)
+        loadFiles({ audioFiles2[0], audioFiles2[1], audioFiles2[2], audioFiles2[3] });
+
+    if (! couldDice && diceCandidates.size() >= 4)
+    {
+        upcomingDicePicks = drawDicePicks();
+        samplePool.prefetch(upcomingDicePicks);
+    }
+}
+
+// Message thread. Adds files Dice can pick, with whatever the analysis index
+// already knows about them.
+void SpecterAudioProcessor::addDiceCandidates(const juce::Array<juce::File>& files)
+{
+    for (const auto& file : files)
+    {
+        if (diceCandidateIndices.contains(file.getFullPathName()))
+            continue;
+
+        diceCandidateIndices.set(file.getFullPathName(), diceCandidates.size());
+        diceCandidates.add({ file, {}, false });
+    }
+
+    analysisIndex->getFeatures(files, [this, &files] (int i, const SampleFeatures& features)
+    {
+        auto& candidate = diceCandidates.getReference(diceCandidateIndices[files.getReference(i).getFullPathName()]);
+        candidate.features = features;
+        candidate.analysed = true;
+    });
+}
+
+// Message thread. Copies in whatever the analysis index has finished since last time.
+void SpecterAudioProcessor::updateDiceCandidates()
+{
+    analysisIndex->getAnalysedSince(analysisCursor, [this] (const juce::String& path, const SampleFeatures& features)
+    {
+        if (diceCandidateIndices.contains(path))
+        {
+            auto& candidate = diceCandidates.getReference(diceCandidateIndices[path]);
+            candidate.features = features;
+            candidate.analysed = true;
+        }
+    });
+}
+
+//=========
+//Dice:
+
+void SpecterAudioProcessor::rollDice()
+{
+    if (diceCandidates.size() < 4)
+        return;
+
+    updateDiceCandidates();
+
+    // Picks drawn for another match mode are drawn again
+    if (upcomingDicePicks.size() < 4 || upcomingDiceMatch != static_cast<int>(diceMatchParam->load()))
+        upcomingDicePicks = drawDicePicks();
+
+    // Move the picks to the front of the list, which is what the editor shows in the quadrants
+    for (int i = 0; i < 4; ++i)
+        audioFiles2.swap(i, audioFiles2.indexOf(upcomingDicePicks[i]));
+
+    // These were prefetched on the last roll, so this is usually just a pointer swap
+    loadFiles(upcomingDicePicks);
+
+    upcomingDicePicks = drawDicePicks();
+    samplePool.prefetch(upcomingDicePicks);
+}
+
+juce::Array<juce::File> SpecterAudioProcessor::drawDicePicks()
+{
+    juce::Array<juce::File> picks;
+
+    if (diceCandidates.size() < 4)
+        return picks;
+
+    // Four distinct files, as if taken from the front of a Fisher-Yates shuffle.
+    // The seed they're drawn from is saved with the session.
+    juce::Array<int> indices;
+    upcomingDiceMatch = static_cast<int>(diceMatchParam->load());
+    diceSeedInUse.store(diceRandom.getSeed());
+
+    indices.add(diceRandom.nextInt(diceCandidates.size()));
+
+    // With a match mode, the other three come from the files closest to the
+    // first one. Anything not analysed yet is left to chance.
+    const auto& first = diceCandidates.getReference(indices[0]);
+
+    if (upcomingDiceMatch != 0 && first.analysed)
+    {
+        struct Candidate { int index; float distance; };
+        std::vector<Candidate> candidates;
+
+        for (int i = 0; i < diceCandidates.size(); ++i)
+        {
+            const auto& other = diceCandidates.getReference(i);
+
+            if (i != indices[0] && other.analysed)
+                candidates.push_back({ i, upcomingDiceMatch == 1 ? first.features.getKeyDistance(other.features)
+                                                                 : first.features.getBrightnessDistance(other.features) });
+        }
+
+        // Closest first, ties in random order so a big library doesn't always give the same set
+        std::shuffle(candidates.begin(), candidates.end(), std::mt19937((std::mt19937::result_type) diceRandom.nextInt()));
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [] (const Candidate& a, const Candidate& b) { return a.distance < b.distance; });
+
+        // A few more than needed, so the same anchor can still roll different sets
+        const auto shortlist = juce::jmin((int) candidates.size(), juce::jmax(3, (int) candidates.size() / 16));
+
+        while (indices.size() < 4 && shortlist >= 3)
+            indices.addIfNotAlreadyThere(candidates[(size_t) diceRandom.nextInt(shortlist)].index);
+    }
+
+    while (indices.size() < 4)
+        indices.addIfNotAlreadyThere(diceRandom.nextInt(diceCandidates.size()));
+
+    for (auto index : indices)
+        picks.add(diceCandidates.getReference(index).file);
+
+    return picks;
 }
 
 //=========
@@ -367,35 +1142,136 @@ void SpecterAudioProcessor::updateAudioFiles(const juce::Array<juce::File>& newF
 
 void SpecterAudioProcessor::setLooping(bool shouldLoop)
 {
-    // Assuming transportSource is your audio playing source and is accessible here
+    // Read by the voices at the end of every block
     isLooping.store(shouldLoop); // Store the loop state in an atomic for thread safety
 }
 
 //================
 //Ball movement:
 
-void SpecterAudioProcessor::setMixLevels(float topLeft, float topRight, float bottomLeft, float bottomRight)
+void SpecterAudioProcessor::setMixPosition(float x, float y)
 {
-    // You might want to lock this operation if these values are accessed in your processBlock
-    const juce::ScopedLock myScopedLock(lock);
-    
-    // Set the member variables that hold the mix levels
-    this->topLeftLevel.store(topLeft);
-    this->topRightLevel.store(topRight);
-    this->bottomLeftLevel.store(bottomLeft);
-    this->bottomRightLevel.store(bottomRight);
+    // Both coordinates go into a single atomic word, so the audio thread can
+    // never see a new x with an old y
+    juce::uint32 xBits, yBits;
+    x = juce::jlimit(0.0f, 1.0f, x);
+    y = juce::jlimit(0.0f, 1.0f, y);
+    std::memcpy(&xBits, &x, sizeof(float));
+    std::memcpy(&yBits, &y, sizeof(float));
+
+    mixPosition.store(((juce::uint64) xBits << 32) | yBits, std::memory_order_release);
+}
+
+juce::Point<float> SpecterAudioProcessor::getMixPosition() const
+{
+    const auto packed = mixPosition.load(std::memory_order_acquire);
+    const auto xBits = (juce::uint32) (packed >> 32);
+    const auto yBits = (juce::uint32) (packed & 0xffffffff);
+    float x, y;
+    std::memcpy(&x, &xBits, sizeof(float));
+    std::memcpy(&y, &yBits, sizeof(float));
+
+    return { x, y };
+}
+
+void SpecterAudioProcessor::startRandomMix(juce::int64 seed)
+{
+    while (seed == 0)
+        seed = juce::Random::getSystemRandom().nextInt64();
+
+    // The seed goes first, so the audio thread has it by the time it sees Rnd
+    // Mix on. The audio thread records it as the one in use when it starts.
+    randomMixSeed.store(seed);
+    setParameterValue("rndMixButton", 1.0f);
+}
 
-    // Now these levels will be used in the processBlock method
+void SpecterAudioProcessor::stopRandomMix()
+{
+    setParameterValue("rndMixButton", 0.0f);
+}
+
+// Audio thread, once a block. Works out how fast the path moves, and when
+// synced puts it where the host's song position says it should be.
+void SpecterAudioProcessor::updateRandomMix()
+{
+    if (randomMixEnabledParam->load() < 0.5f)
+    {
+        randomMixActive = false;
+        return;
+    }
+
+    randomMixShape = randomMixShapeParam->load() >= 0.5f ? MixTrajectory::Shape::smooth : MixTrajectory::Shape::straight;
+    double phase = -1.0;
+
+    if (randomMixSyncParam->load() >= 0.5f)
+    {
+        double bpm = 120.0, beatsPerBar = 4.0;
+        juce::Optional<double> ppq;
+
+        if (auto* playHead = getPlayHead())
+        {
+            if (const auto position = playHead->getPosition())
+            {
+                if (const auto hostBpm = position->getBpm(); hostBpm.hasValue() && *hostBpm > 0.0)
+                    bpm = *hostBpm;
+
+                if (const auto signature = position->getTimeSignature(); signature.hasValue() && signature->denominator > 0)
+                    beatsPerBar = signature->numerator * 4.0 / signature->denominator;
+
+                if (position->getIsPlaying())
+                    ppq = position->getPpqPosition();
+            }
+        }
+
+        // 1/16 up to 1/2 in beats, then 1, 2 or 4 bars
+        const auto division = static_cast<int>(randomMixDivisionParam->load());
+        const auto beatsPerSegment = division < 4 ? 0.25 * (1 << division) : beatsPerBar * (1 << (division - 4));
+
+        randomMixSegmentsPerSample = bpm / (60.0 * beatsPerSegment * currentSampleRate);
+
+        // While the host plays, the song position sets the phase outright
+        if (ppq.hasValue())
+            phase = *ppq / beatsPerSegment;
+    }
+    else
+    {
+        randomMixSegmentsPerSample = 1.0 / (randomMixTimeParam->load() * currentSampleRate);
+    }
+
+    if (phase >= 0.0)
+        mixTrajectory.setPhase(phase);
+
+    // A new loop from startRandomMix, or Rnd Mix switched on some other way,
+    // such as host automation. Either way it starts where the mix is now, and
+    // its seed is what the session saves, so reopening it gives the same loop.
+    auto seed = randomMixSeed.exchange(0);
+
+    if (seed != 0 || ! randomMixActive)
+    {
+        if (seed == 0)
+            seed = nextRandomMixSeed++;
+
+        randomMixSeedInUse.store(seed);
+        mixTrajectory.start({ smoothedMixX.getCurrentValue(), smoothedMixY.getCurrentValue() }, seed, juce::jmax(0.0, phase));
+    }
+
+    randomMixActive = true;
 }
 
-void SpecterAudioProcessor::getMixLevels(float& topLeft, float& topRight, float& bottomLeft, float& bottomRight) const
+// Audio thread. Where the mix is numSamples on: along the Rnd Mix path if it's
+// running, otherwise gliding towards the ball.
+juce::Point<float> SpecterAudioProcessor::advanceMixPosition(int numSamples)
 {
-    // Retrieve the mix levels from where they are stored
-    // This could be an atomic or some thread-safe mechanism
-    topLeft = topLeftLevel.load();
-    topRight = topRightLevel.load();
-    bottomLeft = bottomLeftLevel.load();
-    bottomRight = bottomRightLevel.load();
+    if (! randomMixActive)
+        return { smoothedMixX.skip(numSamples), smoothedMixY.skip(numSamples) };
+
+    const auto position = mixTrajectory.advance(numSamples * randomMixSegmentsPerSample, randomMixShape);
+    smoothedMixX.setCurrentAndTargetValue(position.x);
+    smoothedMixY.setCurrentAndTargetValue(position.y);
+
+    // The editor draws the ball from this
+    setMixPosition(position.x, position.y);
+    return position;
 }
 
 //================
@@ -403,7 +1279,6 @@ void SpecterAudioProcessor::getMixLevels(float& topLeft, float& topRight, float&
 
 void SpecterAudioProcessor::randomizeReverbParameters()
 {
-    // Assuming you have a Random object named 'random' in your class
     // Define the ranges for each parameter
     const float minRoomSize = 0.1f;
     const float maxRoomSize = 1.0f;
@@ -418,57 +1293,79 @@ void SpecterAudioProcessor::randomizeReverbParameters()
     const float minFreezeMode = 0.0f;
     const float maxFreezeMode = 1.0f;
 
-    // Generate random parameters within the specified ranges
-    float roomSize = random.nextFloat() * (maxRoomSize - minRoomSize) + minRoomSize;
-    float damping = random.nextFloat() * (maxDamping - minDamping) + minDamping;
-    float wetLevel = random.nextFloat() * (maxWetLevel - minWetLevel) + minWetLevel;
-    float dryLevel = random.nextFloat() * (maxDryLevel - minDryLevel) + minDryLevel;
-    float width = random.nextFloat() * (maxWidth - minWidth) + minWidth;
-    float freezeMode = random.nextFloat() * (maxFreezeMode - minFreezeMode) + minFreezeMode;
-
-    // Update reverb parameters
-    reverbEffect.updateParameters(roomSize, damping, wetLevel, dryLevel, width, freezeMode);
+    // Generate random parameters within the specified ranges and hand them
+    // to the host; the reverb itself is only touched by the audio thread
+    setParameterValue("reverbRoomSize", random.nextFloat() * (maxRoomSize - minRoomSize) + minRoomSize);
+    setParameterValue("reverbDamping", random.nextFloat() * (maxDamping - minDamping) + minDamping);
+    setParameterValue("reverbWetLevel", random.nextFloat() * (maxWetLevel - minWetLevel) + minWetLevel);
+    setParameterValue("reverbDryLevel", random.nextFloat() * (maxDryLevel - minDryLevel) + minDryLevel);
+    setParameterValue("reverbWidth", random.nextFloat() * (maxWidth - minWidth) + minWidth);
+    setParameterValue("reverbFreeze", random.nextFloat() * (maxFreezeMode - minFreezeMode) + minFreezeMode);
 }
 
 void SpecterAudioProcessor::randomizeLowPassFilterParameters()
 {
-    // Assuming you have a Random object named 'random' in your class
     // Define the ranges for each parameter
     const float minCutoffFrequency = 20.0f;  // Minimum frequency in Hz
     const float maxCutoffFrequency = 20000.0f;  // Maximum frequency in Hz
     const float minQualityFactor = 0.1f;  // Minimum quality factor (Q)
     const float maxQualityFactor = 10.0f;  // Maximum quality factor (Q)
 
-    // Generate random parameters within the specified ranges
-    float cutoffFrequency = random.nextFloat() * (maxCutoffFrequency - minCutoffFrequency) + minCutoffFrequency;
-    float qualityFactor = random.nextFloat() * (maxQualityFactor - minQualityFactor) + minQualityFactor;
+    setParameterValue("filterCutoff", random.nextFloat() * (maxCutoffFrequency - minCutoffFrequency) + minCutoffFrequency);
+    setParameterValue("filterResonance", random.nextFloat() * (maxQualityFactor - minQualityFactor) + minQualityFactor);
+}
 
+void SpecterAudioProcessor::randomizeCornerFilterParameters(int corner)
+{
+    // Same ranges as the bus filter, plus a mode and some drive
+    const float minCutoffFrequency = 20.0f;
+    const float maxCutoffFrequency = 20000.0f;
+    const float minQualityFactor = 0.1f;
+    const float maxQualityFactor = 10.0f;
+    const auto id = "corner" + juce::String(corner + 1);
+
+    setParameterValue(id + "FilterMode", (float) random.nextInt(4));
+    setParameterValue(id + "FilterCutoff", random.nextFloat() * (maxCutoffFrequency - minCutoffFrequency) + minCutoffFrequency);
+    setParameterValue(id + "FilterResonance", random.nextFloat() * (maxQualityFactor - minQualityFactor) + minQualityFactor);
+    setParameterValue(id + "Drive", random.nextFloat());
+}
 
-    // Update the low pass filter parameters
-    lowPassFilterEffect.updateParameters(cutoffFrequency, qualityFactor);
+void SpecterAudioProcessor::randomizeCornerFilterParameters()
+{
+    for (int corner = 0; corner < CornerFilterBank::numCorners; ++corner)
+        randomizeCornerFilterParameters(corner);
 }
 
-void SpecterAudioProcessor::processOscillatorEffect(juce::AudioBuffer<float>& buffer, SampleOscillator& oscillator)
+void SpecterAudioProcessor::randomizeGranularParameters()
 {
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
-        auto* channelData = buffer.getWritePointer(channel);
+    // Kept inside what sounds like a cloud rather than the full parameter ranges
+    const float minDensity = 5.0f;
+    const float maxDensity = 400.0f;
+    const float minSizeMs = 20.0f;
+    const float maxSizeMs = 300.0f;
+
+    setParameterValue("grainDensity", random.nextFloat() * (maxDensity - minDensity) + minDensity);
+    setParameterValue("grainSize", random.nextFloat() * (maxSizeMs - minSizeMs) + minSizeMs);
+    setParameterValue("grainJitter", random.nextFloat());
+    setParameterValue("grainSpread", random.nextFloat());
+}
 
-        // This buffer will store the intermediate short values
-        std::vector<short> shortBuffer(buffer.getNumSamples());
-        
-        // Convert float to short
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
-            shortBuffer[sample] = static_cast<short>(std::numeric_limits<short>::max() * channelData[sample]);
-        }
-       
-        // Process the buffer with the SampleOscillator
-        shortBuffer = oscillator.oscillateBuffer(shortBuffer);
-       
-        // Convert back to float and write back to the buffer
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
-            channelData[sample] = shortBuffer[sample] / static_cast<float>(std::numeric_limits<short>::max());
-        }
-        
-    
+// Sets a parameter in its own units as one gesture, so hosts that record
+// automation pick up the change like any other edit
+void SpecterAudioProcessor::setParameterValue(const juce::String& parameterID, float value)
+{
+    if (auto* parameter = apvts.getParameter(parameterID))
+    {
+        parameter->beginChangeGesture();
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        parameter->endChangeGesture();
     }
 }
+
+void SpecterAudioProcessor::processOscillatorEffect(juce::AudioBuffer<float>& buffer, SampleOscillator& oscillator,
+                                                    int startSample, int numSamples)
+{
+    // Works on the floats directly; the oscillator keeps its zone position
+    // from the previous block, so this doesn't depend on the block size.
+    oscillator.process(buffer, startSample, numSamples);
+}
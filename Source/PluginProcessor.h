@@ -9,16 +9,30 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <array>
 #include <atomic>
 #include "Reverb.h"
 #include "Filter.h"
 #include "Oscillate.h"
+#include "EngineSnapshot.h"
+#include "SamplePool.h"
+#include "MixKernel.h"
+#include "VoiceEngine.h"
+#include "CornerFilterBank.h"
+#include "RenderWorkerPool.h"
+#include "GranularEngine.h"
+#include "SampleAnalysis.h"
+#include "LibraryScanner.h"
+#include "MixTrajectory.h"
+#include "CornerMeters.h"
+#include "PerfCounters.h"
 
 
 //==============================================================================
 /**
 */
-class SpecterAudioProcessor  : public juce::AudioProcessor
+class SpecterAudioProcessor  : public juce::AudioProcessor,
+                               private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -62,18 +76,48 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
     void loadFiles(const juce::Array<juce::File>& files);
     void updateAudioFiles(const juce::Array<juce::File>& newFiles);
+    // Message thread. Scans the folder in the background, subfolders and all,
+    // adding files to the library as they are found; the first four play.
+    void scanLibrary(const juce::File& folder, bool forceRescan = false);
+    bool isScanningLibrary() const { return libraryScanner.isScanning(); }
+    void rollDice();
     juce::Array<juce::File> audioFiles2;
     const juce::Array<juce::File>& getAudioFiles() const { return audioFiles2; }
     void setLooping(bool shouldLoop);
-    void setMixLevels(float topLeft, float topRight, float bottomLeft, float bottomRight);
-    std::atomic<float> ballPosX{0.5f}; // Default x position (0.5 for center)
-    std::atomic<float> ballPosY{0.5f};
-    void getMixLevels(float& topLeft, float& topRight, float& bottomLeft, float& bottomRight) const;
+    bool getLooping() const { return isLooping.load(); }
+    int getNumStreamUnderruns() const { return streamUnderruns.load(); }
+    int getNumSetsLoaded() const { return numSetsLoaded.load(); } // Sets of four the audio thread has been handed so far
+    // Where the ball is on the pad, x and y in 0..1 with (0, 0) at the top left.
+    // Both are published together, and processBlock glides the mix towards them.
+    void setMixPosition(float x, float y);
+    juce::Point<float> getMixPosition() const;
+    // Rnd Mix. The audio thread moves the mix around a loop of four random
+    // waypoints and publishes where it is through setMixPosition. A seed of 0
+    // picks one at random; the same seed always draws the same loop.
+    void startRandomMix(juce::int64 seed = 0);
+    void stopRandomMix();
+    // Message thread. Each corner's level and playhead since the last call;
+    // false if no blocks have been processed since.
+    bool pullCornerMeters(CornerMeterFrame& frame) { return cornerMeters.pull(frame); }
+    // Longest stretch rendered in one go. Blocks are also split at every MIDI
+    // event, so shorter means finer parameter updates at a little more overhead.
+    void setMaxSubBlockSize(int numSamples);
+    // Extra threads for rendering voices and corners in parallel. 0, the
+    // default, renders everything on the host's audio thread. Takes effect
+    // at the next prepareToPlay.
+    void setNumRenderWorkers(int numWorkers);
+    int getNumRenderWorkers() const { return renderWorkers.getNumWorkers(); }
+    // Times waited on the render workers, the only waiting the audio thread does
+    int getNumRenderWorkerWaits() const { return renderWorkers.getNumWaits(); }
+    PerfCounters perfCounters; // Stage timings for the overlay, off unless it's showing
     juce::AudioProcessorValueTreeState apvts;
     ReverbEffect reverbEffect; 
-    SampleOscillator sampleOscillator;
+    SampleOscillator cornerOscillators[EngineSnapshot::numCorners]; // One per corner, so each keeps its own zone position
     LowPassFilterEffect lowPassFilterEffect;
-    void processOscillatorEffect(juce::AudioBuffer<float>& buffer, SampleOscillator& oscillator);
+    CornerFilterBank cornerFilterBank; // Runs on the corner buffers before they are mixed
+    GranularEngine granularEngine; // Grains started by the voices, added after the corner mix
+    SpectralMorph spectralMorph;   // Shared by the voices; each keeps its own stream
+    void processOscillatorEffect(juce::AudioBuffer<float>& buffer, SampleOscillator& oscillator, int startSample, int numSamples);
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
     {
         juce::AudioProcessorValueTreeState::ParameterLayout layout;
@@ -96,12 +140,209 @@ public:
             false
         ));
 
+        // How sample files are held for playback. Memory-mapped only applies to
+        // PCM WAV/AIFF; anything else is decoded as usual. Streamed keeps just
+        // the start of each file in memory and reads the rest as it plays.
+        layout.add(std::make_unique<juce::AudioParameterChoice>(
+            juce::ParameterID { "loadMode", 1 },
+            "Sample Loading",
+            juce::StringArray { "Decoded", "Memory-mapped", "Streamed" },
+            0
+        ));
+
+        // What Dice looks for when it picks four files, from the analysis index
+        layout.add(std::make_unique<juce::AudioParameterChoice>(
+            juce::ParameterID { "diceMatch", 1 },
+            "Dice Match",
+            juce::StringArray { "Anything", "Similar Key", "Similar Brightness" },
+            0
+        ));
+
+        // Brings every corner to the same loudness, from the same analysis
+        layout.add(std::make_unique<juce::AudioParameterBool>(
+            juce::ParameterID { "normalizeLoudness", 1 }, "Normalize Loudness", true));
+
+        // Rnd Mix: how long the ball takes from one waypoint to the next, in
+        // seconds or, synced, in note lengths at the host's tempo
+        layout.add(std::make_unique<juce::AudioParameterBool>(
+            juce::ParameterID { "rndMixButton", 1 }, "Rnd Mix On/Off", false));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "rndMixTime", 1 }, "Rnd Mix Segment Time",
+            juce::NormalisableRange<float>(0.05f, 10.0f, 0.0f, 0.3f), 1.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterBool>(
+            juce::ParameterID { "rndMixSync", 1 }, "Rnd Mix Tempo Sync", false));
+
+        layout.add(std::make_unique<juce::AudioParameterChoice>(
+            juce::ParameterID { "rndMixDivision", 1 },
+            "Rnd Mix Synced Segment",
+            juce::StringArray { "1/16", "1/8", "1/4", "1/2", "1 Bar", "2 Bars", "4 Bars" },
+            4
+        ));
+
+        layout.add(std::make_unique<juce::AudioParameterChoice>(
+            juce::ParameterID { "rndMixShape", 1 },
+            "Rnd Mix Path",
+            juce::StringArray { "Straight", "Smooth" },
+            1
+        ));
+
+        // Voices: how many notes can sound at once, and the envelope each one gets
+        layout.add(std::make_unique<juce::AudioParameterInt>(
+            juce::ParameterID { "polyphony", 1 },
+            "Polyphony",
+            1, VoiceEngine::maxVoices, 8
+        ));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "attack", 1 },
+            "Attack",
+            juce::NormalisableRange<float>(0.001f, 5.0f, 0.0f, 0.3f),
+            0.005f
+        ));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "decay", 1 },
+            "Decay",
+            juce::NormalisableRange<float>(0.001f, 5.0f, 0.0f, 0.3f),
+            0.1f
+        ));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "sustain", 1 },
+            "Sustain",
+            juce::NormalisableRange<float>(0.0f, 1.0f),
+            1.0f
+        ));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "release", 1 },
+            "Release",
+            juce::NormalisableRange<float>(0.001f, 10.0f, 0.0f, 0.3f),
+            0.2f
+        ));
+
+        // How voices read their samples between frames when pitched
+        layout.add(std::make_unique<juce::AudioParameterChoice>(
+            juce::ParameterID { "interpolation", 1 },
+            "Interpolation",
+            juce::StringArray { "Linear", "Cubic Hermite", "Windowed Sinc" },
+            1
+        ));
+
+        // Reverb, filter and oscillator settings. The Randomize buttons write
+        // these, so the host can automate and recall whatever they came up with.
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "reverbRoomSize", 1 }, "Reverb Room Size",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.5f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "reverbDamping", 1 }, "Reverb Damping",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.5f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "reverbWetLevel", 1 }, "Reverb Wet Level",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.33f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "reverbDryLevel", 1 }, "Reverb Dry Level",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.4f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "reverbWidth", 1 }, "Reverb Width",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 1.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "reverbFreeze", 1 }, "Reverb Freeze",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterChoice>(
+            juce::ParameterID { "filterMode", 1 }, "Filter Mode",
+            juce::StringArray { "Low-pass", "High-pass", "Band-pass", "Notch" }, 0));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "filterCutoff", 1 }, "Filter Cutoff",
+            juce::NormalisableRange<float>(20.0f, 20000.0f, 0.0f, 0.25f), 20000.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "filterResonance", 1 }, "Filter Q",
+            juce::NormalisableRange<float>(0.1f, 10.0f, 0.0f, 0.4f), 0.7071f));
+
+        // A filter and drive for each corner, ahead of the mix, so every
+        // corner can get its own colour
+        layout.add(std::make_unique<juce::AudioParameterBool>(
+            juce::ParameterID { "cornerFilterButton", 1 }, "Corner Filters On/Off", false));
+
+        for (int corner = 1; corner <= CornerFilterBank::numCorners; ++corner)
+        {
+            const auto id = "corner" + juce::String(corner);
+            const auto name = "Corner " + juce::String(corner) + " ";
+
+            layout.add(std::make_unique<juce::AudioParameterChoice>(
+                juce::ParameterID { id + "FilterMode", 1 }, name + "Filter Mode",
+                juce::StringArray { "Low-pass", "High-pass", "Band-pass", "Notch" }, 0));
+
+            layout.add(std::make_unique<juce::AudioParameterFloat>(
+                juce::ParameterID { id + "FilterCutoff", 1 }, name + "Filter Cutoff",
+                juce::NormalisableRange<float>(20.0f, 20000.0f, 0.0f, 0.25f), 20000.0f));
+
+            layout.add(std::make_unique<juce::AudioParameterFloat>(
+                juce::ParameterID { id + "FilterResonance", 1 }, name + "Filter Q",
+                juce::NormalisableRange<float>(0.1f, 10.0f, 0.0f, 0.4f), 0.7071f));
+
+            layout.add(std::make_unique<juce::AudioParameterFloat>(
+                juce::ParameterID { id + "Drive", 1 }, name + "Drive",
+                juce::NormalisableRange<float>(0.0f, 1.0f), 0.0f));
+        }
+
+        // Granular playback, in place of the voices playing the corners straight
+        layout.add(std::make_unique<juce::AudioParameterBool>(
+            juce::ParameterID { "granularButton", 1 }, "Granular On/Off", false));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "grainDensity", 1 }, "Grain Density",
+            juce::NormalisableRange<float>(1.0f, 2000.0f, 0.0f, 0.3f), 40.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "grainSize", 1 }, "Grain Size",
+            juce::NormalisableRange<float>(5.0f, 500.0f, 0.0f, 0.4f), 80.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "grainJitter", 1 }, "Grain Jitter",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.2f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "grainSpread", 1 }, "Grain Spread",
+            juce::NormalisableRange<float>(0.0f, 1.0f), 0.5f));
+
+        // Morphs between the corners' spectra rather than crossfading them
+        layout.add(std::make_unique<juce::AudioParameterBool>(
+            juce::ParameterID { "spectralButton", 1 }, "Spectral Morph On/Off", false));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "oscillatorFrequency", 1 }, "Oscillate Frequency",
+            juce::NormalisableRange<float>(1.0f, 2000.0f, 0.0f, 0.3f), 440.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "oscillatorZoneLength", 1 }, "Oscillate Zone Length",
+            juce::NormalisableRange<float>(0.001f, 1.0f, 0.0f, 0.3f), 4.0f / 440.0f));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID { "oscillatorOverlap", 1 }, "Oscillate Overlap",
+            juce::NormalisableRange<float>(0.0f, 99.0f), 50.0f));
 
         return layout;
     }
+    // Message thread only. These pick new values and write them to the
+    // parameters; the audio thread applies them at its next sub-block.
     void randomizeReverbParameters();
     void randomizeLowPassFilterParameters();
-    std::vector<short> convertToShort(const juce::AudioBuffer<float>& buffer, int channel) {
+    void randomizeCornerFilterParameters(int corner); // corner 0 to 3, top left to bottom right
+    void randomizeCornerFilterParameters(); // Every corner, each with its own settings
+    void randomizeGranularParameters();
+    void setParameterValue(const juce::String& parameterID, float value);
+    static std::vector<short> convertToShort(const juce::AudioBuffer<float>& buffer, int channel) {
     std::vector<short> shortBuffer(buffer.getNumSamples());
 
         // Convert each float sample to a short, assuming the float is in the range -1.0 to 1.0
@@ -120,7 +361,7 @@ public:
         }
 
 
-    void convertToFloat(juce::AudioBuffer<float>& buffer, const std::vector<short>& shortBuffer, int channel) {
+    static void convertToFloat(juce::AudioBuffer<float>& buffer, const std::vector<short>& shortBuffer, int channel) {
         // Assuming the buffer size and shortBuffer size match
         for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
             // Normalize the short value to a floating-point value in the range [-1.0, 1.0]
@@ -132,19 +373,128 @@ public:
     }
 private:
     //==============================================================================
+    void timerCallback() override;
+    std::unique_ptr<EngineSnapshot> createSnapshot(const juce::Array<SampleData::Ptr>& samples);
+    bool updateLoadMode();
+    void updateSampleModeData();
+    void applyNormalizationGains();
+    juce::Array<juce::File> drawDicePicks();
+    void addDiceCandidates(const juce::Array<juce::File>& files);
+    void updateDiceCandidates();
+    void redrawRestoredDicePicks();
+    void addAudioFiles(const juce::Array<juce::File>& newFiles);
+    void handleMidiEvent(const juce::MidiMessage& message, EngineSnapshot* engine);
+    void renderSegment(juce::AudioBuffer<float>& buffer, EngineSnapshot* engine, int startSample, int numSamples);
+    void updateRandomMix();
+    juce::Point<float> advanceMixPosition(int numSamples);
+    void updateEffectParameters();
+    void renderCorners(int startSample, int numSamples, const VoiceRenderSettings& settings);
+
     juce::AudioFormatManager formatManager;
-    juce::AudioTransportSource transportSource[4]; // Assuming you have 4 transport sources
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource[4];
-    juce::CriticalSection lock;  // To protect the shared resources during audio processing
-    int samplesPerBlockExpected;
+    juce::SharedResourcePointer<SampleAnalysisIndex> analysisIndex; // Loudness, pitch and brightness of the library, for Dice and the corner gains; shared by every instance
+    LibraryScanner libraryScanner { formatManager };
+    juce::TimeSliceThread readAheadThread { "Specter read-ahead" }; // Keeps upcoming sample data resident for the sources
+    std::atomic<int> streamUnderruns { 0 };
+    std::atomic<int> numSetsLoaded { 0 };
+    SampleData::PlaybackContext playbackContext { readAheadThread, streamUnderruns };
+    EngineSnapshotExchange engineSnapshots; // The four corner sources, swapped in without locking the audio thread
+    SamplePool samplePool; // Declared after engineSnapshots so its thread stops before they go away
+    juce::CriticalSection samplesAwaitingGainLock;
+    juce::Array<SampleData::Ptr> samplesAwaitingGain; // Loaded before the analysis index had measured them
+    // Every file Dice can pick, in the order it was found, with what the
+    // analysis index knows about it. Message thread only.
+    struct DiceCandidate
+    {
+        juce::File file;
+        SampleFeatures features;
+        bool analysed = false;
+    };
+    juce::Array<DiceCandidate> diceCandidates;
+    juce::HashMap<juce::String, int> diceCandidateIndices; // By full path
+    int analysisCursor = 0; // For SampleAnalysisIndex::getAnalysedSince
+    juce::Array<juce::File> upcomingDicePicks; // Already being decoded by samplePool
+    int upcomingDiceMatch = 0; // The diceMatch setting upcomingDicePicks were drawn with
+    juce::Random diceRandom;   // Only for Dice, so other random buttons don't change what it picks
+    std::atomic<juce::int64> diceSeedInUse { 0 }; // diceRandom's seed before upcomingDicePicks were drawn, saved with the session
+    juce::int64 restoredDiceSeed = 0; // From a restored session, waiting for the library to come in
+    juce::Array<juce::File> currentFiles; // The four files last passed to loadFiles
+    juce::File libraryFolder;             // The folder last scanned
+    bool keepLoadedFiles = false;         // The scan is for a restored session, so it mustn't replace currentFiles
+    std::atomic<juce::int64> randomMixSeedInUse { 0 }; // Seed of the last Rnd Mix loop started, however it was, saved with the session
+    juce::CriticalSection pendingSessionLock; // Guards pendingSession and the saved copies below
+    juce::ValueTree pendingSession;       // Restored off the message thread, waiting for the timer
+    juce::Array<juce::File> savedFiles;   // currentFiles and libraryFolder as getStateInformation sees them,
+    juce::File savedLibraryFolder;        // from whichever thread the host calls it on
+    void restoreSession(const juce::ValueTree& session);
+    void publishSessionFiles();
+    int appliedLoadMode = 0;
+    juce::CriticalSection preparedSpecLock; // Guards the block size and rate while snapshots are built or prepared
+    int samplesPerBlockExpected = 512;
     juce::Random random;
-    double currentSampleRate;
+    double currentSampleRate = 44100.0;
+    juce::AudioBuffer<float> cornerBuffers[EngineSnapshot::numCorners]; // Sized in prepareToPlay, mixed by BilinearMix
+    std::atomic<float>* reverbEnabledParam = nullptr;
+    std::atomic<float>* filterEnabledParam = nullptr;
+    std::atomic<float>* oscillatorEnabledParam = nullptr;
+    std::atomic<float>* polyphonyParam = nullptr;
+    std::atomic<float>* attackParam = nullptr;
+    std::atomic<float>* decayParam = nullptr;
+    std::atomic<float>* sustainParam = nullptr;
+    std::atomic<float>* releaseParam = nullptr;
+    std::atomic<float>* interpolationParam = nullptr;
+    std::atomic<float>* reverbRoomSizeParam = nullptr;
+    std::atomic<float>* reverbDampingParam = nullptr;
+    std::atomic<float>* reverbWetLevelParam = nullptr;
+    std::atomic<float>* reverbDryLevelParam = nullptr;
+    std::atomic<float>* reverbWidthParam = nullptr;
+    std::atomic<float>* reverbFreezeParam = nullptr;
+    std::atomic<float>* filterModeParam = nullptr;
+    std::atomic<float>* filterCutoffParam = nullptr;
+    std::atomic<float>* filterResonanceParam = nullptr;
+    std::atomic<float>* cornerFilterEnabledParam = nullptr;
+    struct CornerFilterParams { std::atomic<float>* mode = nullptr, * cutoff = nullptr, * resonance = nullptr, * drive = nullptr; };
+    CornerFilterParams cornerFilterParams[CornerFilterBank::numCorners];
+    std::atomic<float>* granularEnabledParam = nullptr;
+    std::atomic<float>* spectralEnabledParam = nullptr;
+    std::atomic<float>* diceMatchParam = nullptr;
+    std::atomic<float>* normalizeLoudnessParam = nullptr;
+    std::atomic<float>* randomMixEnabledParam = nullptr;
+    std::atomic<float>* randomMixTimeParam = nullptr;
+    std::atomic<float>* randomMixSyncParam = nullptr;
+    std::atomic<float>* randomMixDivisionParam = nullptr;
+    std::atomic<float>* randomMixShapeParam = nullptr;
+    std::atomic<float>* grainDensityParam = nullptr;
+    std::atomic<float>* grainSizeParam = nullptr;
+    std::atomic<float>* grainJitterParam = nullptr;
+    std::atomic<float>* grainSpreadParam = nullptr;
+    std::atomic<float>* oscillatorFrequencyParam = nullptr;
+    std::atomic<float>* oscillatorZoneLengthParam = nullptr;
+    std::atomic<float>* oscillatorOverlapParam = nullptr;
+    // What the effects were last set to, audio thread only. NaN forces an update.
+    std::array<float, 6> appliedReverbSettings;
+    std::array<float, 3> appliedFilterSettings;
+    std::array<float, 3> appliedOscillatorSettings;
+    std::array<float, 4 * CornerFilterBank::numCorners> appliedCornerFilterSettings;
+    float appliedCornerGains[EngineSnapshot::numCorners] = { 1.0f, 1.0f, 1.0f, 1.0f }; // Normalization gains last mixed with, audio thread only
+    bool cornerFilterRunning = false; // The corner filters ran in the last segment, audio thread only
+    double pitchBend = 1.0; // From the pitch wheel, audio thread only
+    std::atomic<int> maxSubBlockSize { 128 };
+    std::atomic<int> requestedRenderWorkers { 0 };
+    RenderWorkerPool renderWorkers; // Configured in prepareToPlay, used by the audio thread
+    VoiceEngine voiceEngine; // Audio thread only, apart from prepareToPlay
+    const EngineSnapshot* voicesSnapshot = nullptr; // The newest snapshot the voices have been told about, only compared
     std::atomic<bool> isLooping;
-    std::atomic<float> topLeftLevel{0.0f};
-    std::atomic<float> topRightLevel{0.0f};
-    std::atomic<float> bottomLeftLevel{0.0f};
-    std::atomic<float> bottomRightLevel{0.0f};
-    bool isTransportSourcePrepared[4] = {false, false, false, false};
+    std::atomic<juce::uint64> mixPosition { 0 }; // x and y packed into one word, see setMixPosition
+    juce::SmoothedValue<float> smoothedMixX { 0.5f }, smoothedMixY { 0.5f }; // Audio thread only
+    std::atomic<juce::int64> randomMixSeed { 0 }; // A new loop for the audio thread to start, 0 for none
+    // Rnd Mix, audio thread only
+    MixTrajectory mixTrajectory;
+    bool randomMixActive = false;
+    double randomMixSegmentsPerSample = 0.0;
+    MixTrajectory::Shape randomMixShape = MixTrajectory::Shape::smooth;
+    juce::int64 nextRandomMixSeed = 1; // For loops started by automation rather than startRandomMix
+    CornerMeterFifo cornerMeters;
+    CornerMeterFrame meterFrame; // Built up over a block, audio thread only
     
     
    
@@ -0,0 +1,277 @@
+/*
+  ==============================================================================
+
+    RenderWorkerPool.h
+    Created: 4 May 2024 6:31:40pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+#endif
+
+// Helper threads that let the audio thread spread one callback's rendering
+// over several cores. run() hands out tasks 0..numTasks-1 to the workers and
+// to the calling thread, and returns once every one of them has finished.
+//
+// Handing out work is lock-free: the generation of the current job and the
+// next task index share one atomic word, so a worker that wakes late can
+// never pick up a task from a job that has already moved on. Between jobs a
+// worker spins for up to one block period, so while audio is running the next
+// hand-off stays down to a cache miss, and then parks on an event so an idle
+// pool costs no CPU.
+//
+// Workers are started and stopped with configure(), which must not overlap
+// with run(); the processor only calls it from prepareToPlay.
+class RenderWorkerPool
+{
+public:
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void runTask(int taskIndex) noexcept = 0;
+    };
+
+    RenderWorkerPool() = default;
+    ~RenderWorkerPool() { configure(0, 0.0); }
+
+    // Starts numWorkers threads, each pinned to its own core after the first.
+    // 0 stops them, and run() then does everything on the calling thread.
+    // blockPeriodSeconds is how long one audio callback's worth of samples
+    // lasts, which is how long an idle worker keeps spinning.
+    void configure(int numWorkers, double blockPeriodSeconds)
+    {
+        const auto spinSeconds = juce::jlimit(0.0, maxSpinSeconds, blockPeriodSeconds);
+        spinTicks.store((juce::int64) (spinSeconds * (double) juce::Time::getHighResolutionTicksPerSecond()), std::memory_order_relaxed);
+
+        numWorkers = juce::jlimit(0, juce::jmax(0, juce::SystemStats::getNumCpus() - 1), numWorkers);
+
+        if (numWorkers == (int) workers.size())
+            return;
+
+        for (auto& worker : workers)
+            worker->signalThreadShouldExit();
+
+        for (auto& worker : workers)
+        {
+            worker->wakeUp.signal();
+            worker->stopThread(1000);
+        }
+
+        workers.clear();
+
+        for (int i = 0; i < numWorkers; ++i)
+        {
+            // Core 0 is left to the host's own audio thread where possible
+            const int core = (i + 1) % juce::jmax(1, juce::SystemStats::getNumCpus());
+
+            workers.push_back(std::make_unique<Worker>(*this, i, core < 32 ? (juce::uint32) 1 << core : 0u));
+            auto& worker = *workers.back();
+
+            if (! worker.startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(8)))
+                worker.startThread(juce::Thread::Priority::highest);
+        }
+    }
+
+    int getNumWorkers() const noexcept { return (int) workers.size(); }
+
+    // How many times the calling thread finished its share of a run() and had
+    // to wait for a worker. Any thread.
+    int getNumWaits() const noexcept { return numWaits.load(std::memory_order_relaxed); }
+
+    // The cost model. Splitting pays if the work divided over the threads,
+    // plus the cost of getting them going, beats doing it all here.
+    bool isWorthSplitting(double estimatedWorkNs, int numTasks) const noexcept
+    {
+        if (workers.empty() || numTasks < 2)
+            return false;
+
+        const auto threads = juce::jmin(numTasks, getNumWorkers() + 1);
+        const auto overheadNs = anyWorkerParked() ? wakeFromParkNs : wakeFromSpinNs;
+        return overheadNs + estimatedWorkNs / threads < estimatedWorkNs;
+    }
+
+    // Runs job.runTask for every index from 0 to numTasks - 1, spread over
+    // the workers and this thread, and waits for all of them. For the audio
+    // thread; it never allocates.
+    void run(Job& job, int numTasks) noexcept
+    {
+        if (numTasks <= 0)
+            return;
+
+        if (workers.empty() || numTasks == 1)
+        {
+            for (int i = 0; i < numTasks; ++i)
+                job.runTask(i);
+
+            return;
+        }
+
+        // Publish the job, then bump the generation; a worker only reads the
+        // job after it has seen the new generation
+        const auto generation = (juce::uint32) (state.load(std::memory_order_relaxed) >> 32) + 1;
+        currentJob.store(&job, std::memory_order_relaxed);
+        currentNumTasks.store(numTasks, std::memory_order_relaxed);
+        tasksFinished.store(0, std::memory_order_relaxed);
+        state.store((juce::uint64) generation << 32, std::memory_order_seq_cst);
+
+        for (auto& worker : workers)
+            if (worker->parked.load(std::memory_order_seq_cst))
+                worker->wakeUp.signal();
+
+        workOn(generation);
+
+        if (tasksFinished.load(std::memory_order_acquire) < numTasks)
+        {
+            numWaits.store(numWaits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            while (tasksFinished.load(std::memory_order_acquire) < numTasks)
+                pause();
+        }
+    }
+
+    // Adapts any callable taking a task index, without allocating
+    template <typename Fn>
+    void run(int numTasks, Fn&& fn) noexcept
+    {
+        struct FunctionJob : Job
+        {
+            explicit FunctionJob(Fn& f) : function(f) {}
+            void runTask(int taskIndex) noexcept override { function(taskIndex); }
+            Fn& function;
+        };
+
+        FunctionJob job(fn);
+        run(job, numTasks);
+    }
+
+private:
+    // Rough figures for a desktop CPU: a spinning worker picks a job up in
+    // about a microsecond, a parked one needs the OS to schedule it
+    static constexpr double wakeFromSpinNs = 2000.0;
+    static constexpr double wakeFromParkNs = 40000.0;
+
+    // Longest a worker spins between jobs, for hosts with very long blocks
+    static constexpr double maxSpinSeconds = 0.005;
+    static constexpr int pausesPerClockCheck = 64;
+
+    struct Worker : public juce::Thread
+    {
+        Worker(RenderWorkerPool& p, int index, juce::uint32 mask)
+            : juce::Thread("Specter render " + juce::String(index + 1)), pool(p), coreMask(mask) {}
+
+        void run() override
+        {
+            // From the thread itself: the Thread's own mask is only read as it starts
+            if (coreMask != 0)
+                juce::Thread::setCurrentThreadAffinityMask(coreMask);
+
+            auto seen = (juce::uint32) (pool.state.load(std::memory_order_acquire) >> 32);
+
+            while (! threadShouldExit())
+            {
+                auto generation = seen;
+                const auto spinUntil = juce::Time::getHighResolutionTicks() + pool.spinTicks.load(std::memory_order_relaxed);
+
+                for (int spin = 1; generation == seen; ++spin)
+                {
+                    pause();
+                    generation = (juce::uint32) (pool.state.load(std::memory_order_acquire) >> 32);
+
+                    if (spin % pausesPerClockCheck == 0 && juce::Time::getHighResolutionTicks() >= spinUntil)
+                        break;
+                }
+
+                if (generation == seen)
+                {
+                    // Nothing came in while spinning, so park. The generation
+                    // is checked again after raising the flag, so a job posted
+                    // in between still gets seen.
+                    parked.store(true, std::memory_order_seq_cst);
+                    generation = (juce::uint32) (pool.state.load(std::memory_order_seq_cst) >> 32);
+
+                    if (generation == seen)
+                        wakeUp.wait(100.0);
+
+                    parked.store(false, std::memory_order_relaxed);
+                    generation = (juce::uint32) (pool.state.load(std::memory_order_acquire) >> 32);
+                }
+
+                if (generation != seen)
+                {
+                    seen = generation;
+                    pool.workOn(generation);
+                }
+            }
+        }
+
+        RenderWorkerPool& pool;
+        const juce::uint32 coreMask; // 0 to leave it to the OS
+        std::atomic<bool> parked { false };
+        juce::WaitableEvent wakeUp;
+    };
+
+    static void pause() noexcept
+    {
+       #if JUCE_USE_SSE_INTRINSICS
+        _mm_pause();
+       #elif JUCE_ARM && ! JUCE_MSVC
+        __asm__ __volatile__ ("yield");
+       #endif
+    }
+
+    // Claims and runs tasks from the given generation until there are none left
+    void workOn(juce::uint32 generation) noexcept
+    {
+        for (;;)
+        {
+            auto current = state.load(std::memory_order_acquire);
+
+            if ((juce::uint32) (current >> 32) != generation)
+                return;
+
+            auto* job = currentJob.load(std::memory_order_relaxed);
+            const auto numTasks = currentNumTasks.load(std::memory_order_relaxed);
+            const auto task = (int) (current & 0xffffffff);
+
+            if (task >= numTasks)
+                return;
+
+            // Only succeeds while this generation still has the task, and a
+            // generation can't end with tasks unclaimed, so job is still ours
+            if (state.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel))
+            {
+                job->runTask(task);
+                tasksFinished.fetch_add(1, std::memory_order_release);
+            }
+        }
+    }
+
+    bool anyWorkerParked() const noexcept
+    {
+        for (auto& worker : workers)
+            if (worker->parked.load(std::memory_order_relaxed))
+                return true;
+
+        return false;
+    }
+
+    std::atomic<juce::uint64> state { 0 }; // Generation in the top half, next task in the bottom
+    std::atomic<Job*> currentJob { nullptr };
+    std::atomic<int> currentNumTasks { 0 };
+    std::atomic<int> tasksFinished { 0 };
+    std::atomic<int> numWaits { 0 }; // Only the thread calling run() writes it
+    std::atomic<juce::int64> spinTicks { 0 }; // How long a worker spins before parking
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderWorkerPool)
+};
@@ -30,7 +30,12 @@ public:
 
     void process(juce::AudioBuffer<float>& buffer)
     {
-        auto block = juce::dsp::AudioBlock<float>(buffer);
+        process(buffer, 0, buffer.getNumSamples());
+    }
+
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        auto block = juce::dsp::AudioBlock<float>(buffer).getSubBlock((size_t) startSample, (size_t) numSamples);
         auto context = juce::dsp::ProcessContextReplacing<float>(block);
         reverb.process(context);
     }
@@ -0,0 +1,519 @@
+/*
+  ==============================================================================
+
+    SampleAnalysis.h
+    Created: 11 May 2024 4:37:19pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// What the analysis finds out about one file
+struct SampleFeatures
+{
+    double durationSeconds = 0.0;
+    float loudness = -70.0f; // Integrated loudness in LUFS, K-weighted and gated as in BS.1770
+    float pitchHz = 0.0f;    // Fundamental, or 0 when there is no steady one
+    float centroidHz = 0.0f; // Spectral centroid, for brightness
+
+    // What brings the file to the target loudness, within reason
+    float getNormalizationGain() const
+    {
+        return juce::Decibels::decibelsToGain(juce::jlimit(-maxCorrectionDb, maxCorrectionDb, targetLoudness - loudness));
+    }
+
+    // 0 for the same pitch class, up to 1 a tritone apart. Anything unpitched
+    // is halfway from everything.
+    float getKeyDistance(const SampleFeatures& other) const
+    {
+        if (pitchHz <= 0.0f || other.pitchHz <= 0.0f)
+            return 0.5f;
+
+        const auto semitones = std::abs(12.0f * std::log2(pitchHz / other.pitchHz));
+        const auto pitchClass = std::fmod(semitones, 12.0f);
+        return juce::jmin(pitchClass, 12.0f - pitchClass) / 6.0f;
+    }
+
+    // Octaves between the two centroids
+    float getBrightnessDistance(const SampleFeatures& other) const
+    {
+        if (centroidHz <= 0.0f || other.centroidHz <= 0.0f)
+            return 1.0f;
+
+        return std::abs(std::log2(centroidHz / other.centroidHz));
+    }
+
+    static constexpr float targetLoudness = -18.0f;
+    static constexpr float maxCorrectionDb = 12.0f;
+};
+
+// Loudness, pitch, brightness and length of every file in the library, worked
+// out on a pool of low-priority threads and kept in a cache file so each file
+// is only ever analysed once. Entries are keyed by path and go stale when the
+// file's modification time changes.
+//
+// Lookups are cheap and never touch the disk, so Dice can use them as often
+// as it likes; anything not analysed yet simply isn't found.
+//
+// Plugin instances share one through a SharedResourcePointer, so there is a
+// single thread pool however many are open. Saving merges with whatever is in
+// the file already, so entries written by another process aren't lost.
+class SampleAnalysisIndex
+{
+public:
+    explicit SampleAnalysisIndex(const juce::File& cache = getDefaultCacheFile())
+        : cacheFile(cache),
+          pool(juce::jmax(1, juce::SystemStats::getNumCpus() - 1), 0, juce::Thread::Priority::low)
+    {
+        formatManager.registerBasicFormats();
+        loadCache();
+    }
+
+    ~SampleAnalysisIndex()
+    {
+        stopping = true;
+        pool.removeAllJobs(true, 5000);
+        saveCache();
+    }
+
+    static juce::File getDefaultCacheFile()
+    {
+        return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                   .getChildFile("Specter").getChildFile("SampleAnalysis.cache");
+    }
+
+    // Message thread. Queues the files to be checked, and analysed if they
+    // have no up-to-date entry. Nothing here touches the disk: even the
+    // modification times are read by the pool's threads.
+    void analyseInBackground(const juce::Array<juce::File>& files)
+    {
+        int workersToStart = 0;
+
+        {
+            const juce::ScopedLock sl(lock);
+
+            for (const auto& file : files)
+            {
+                if (queued.contains(file.getFullPathName()))
+                    continue;
+
+                queued.set(file.getFullPathName(), true);
+                queue.add(file);
+                ++numPending;
+            }
+
+            workersToStart = juce::jmin(queue.size() - queueHead, pool.getNumThreads()) - numWorkers;
+            numWorkers += juce::jmax(0, workersToStart);
+        }
+
+        for (int i = 0; i < workersToStart; ++i)
+            pool.addJob([this] { workThroughQueue(); });
+    }
+
+    // Any thread but the audio thread. False if the file hasn't been analysed.
+    bool getFeatures(const juce::File& file, SampleFeatures& features) const
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (! entries.contains(file.getFullPathName()))
+            return false;
+
+        features = entries[file.getFullPathName()].features;
+        return true;
+    }
+
+    // Any thread but the audio thread. Looks up every file in one go, and
+    // calls found(index, features) for each one that has been analysed.
+    template <typename Found>
+    void getFeatures(const juce::Array<juce::File>& files, Found&& found) const
+    {
+        const juce::ScopedLock sl(lock);
+
+        for (int i = 0; i < files.size(); ++i)
+            if (entries.contains(files.getReference(i).getFullPathName()))
+                found(i, entries[files.getReference(i).getFullPathName()].features);
+    }
+
+    // Any thread but the audio thread. Calls found(path, features) for every
+    // file analysed since cursor, which starts at 0, and moves cursor on. Along
+    // with a getFeatures() of the files when they were added, this keeps a
+    // copy of the features up to date without going over every file again.
+    template <typename Found>
+    void getAnalysedSince(int& cursor, Found&& found) const
+    {
+        const juce::ScopedLock sl(lock);
+
+        for (; cursor < analysed.size(); ++cursor)
+            found(analysed[cursor], entries[analysed[cursor]].features);
+    }
+
+    int getNumPending() const { return numPending.load(); }
+
+    // Reads up to maxSeconds of the file and measures it. Slow; any thread.
+    static bool analyseFile(juce::AudioFormatManager& manager, const juce::File& file, SampleFeatures& features)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(manager.createReaderFor(file));
+
+        if (reader == nullptr || reader->sampleRate <= 0.0 || reader->numChannels == 0)
+            return false;
+
+        const auto sampleRate = reader->sampleRate;
+        const auto length = (int) juce::jmin(reader->lengthInSamples, (juce::int64) (sampleRate * maxSeconds));
+        features.durationSeconds = (double) reader->lengthInSamples / sampleRate;
+
+        if (length <= 0)
+            return true;
+
+        juce::AudioBuffer<float> audio((int) reader->numChannels, length);
+        reader->read(&audio, 0, length, 0, true, true);
+
+        // Pitch and brightness from a mono mix, taken before the loudness
+        // measurement filters the audio in place
+        std::vector<float> mono((size_t) length, 0.0f);
+
+        for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+            juce::FloatVectorOperations::addWithMultiply(mono.data(), audio.getReadPointer(channel),
+                                                         1.0f / (float) audio.getNumChannels(), length);
+
+        features.loudness = measureLoudness(audio, sampleRate);
+        features.pitchHz = measurePitch(mono, sampleRate);
+        features.centroidHz = measureCentroid(mono, sampleRate);
+        return true;
+    }
+
+private:
+    struct Entry
+    {
+        juce::Time modified;
+        SampleFeatures features;
+    };
+
+    static constexpr double maxSeconds = 30.0;
+    static constexpr int cacheVersion = 1;
+
+    // On the pool's threads, until the queue is empty
+    void workThroughQueue()
+    {
+        for (;;)
+        {
+            juce::File file;
+
+            {
+                const juce::ScopedLock sl(lock);
+
+                if (stopping || queueHead >= queue.size())
+                {
+                    queue.clearQuick();
+                    queueHead = 0;
+                    --numWorkers;
+                    return;
+                }
+
+                file = queue.getReference(queueHead++);
+            }
+
+            const auto path = file.getFullPathName();
+            const auto modified = file.getLastModificationTime();
+            bool upToDate = false;
+
+            {
+                const juce::ScopedLock sl(lock);
+                upToDate = entries.contains(path) && entries[path].modified == modified;
+            }
+
+            SampleFeatures features;
+            const bool ok = ! upToDate && analyseFile(formatManager, file, features);
+
+            {
+                const juce::ScopedLock sl(lock);
+                queued.remove(path);
+
+                if (ok)
+                {
+                    entries.set(path, { modified, features });
+                    analysed.add(path);
+                    unsaved = true;
+                }
+            }
+
+            // The last file of a batch writes the cache, if there's anything new
+            if (--numPending == 0 && ! stopping && unsaved.exchange(false))
+                saveCache();
+        }
+    }
+
+    //==============================================================================
+    // BS.1770: K-weight every channel in place, take the mean square over
+    // 400 ms blocks overlapping by three quarters, and average the blocks that
+    // pass the absolute gate at -70 and then the relative one 10 LU below the
+    // first average
+    static float measureLoudness(juce::AudioBuffer<float>& audio, double sampleRate)
+    {
+        const int length = audio.getNumSamples();
+        const int blockLength = (int) (sampleRate * 0.4);
+        const int hop = juce::jmax(1, blockLength / 4);
+
+        for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+        {
+            juce::IIRFilter shelf, highPass;
+            shelf.setCoefficients(juce::IIRCoefficients::makeHighShelf(sampleRate, 1500.0, 0.7071, 1.585f));
+            highPass.setCoefficients(juce::IIRCoefficients::makeHighPass(sampleRate, 38.0, 0.5));
+            shelf.processSamples(audio.getWritePointer(channel), length);
+            highPass.processSamples(audio.getWritePointer(channel), length);
+        }
+
+        std::vector<double> blocks;
+
+        for (int start = 0; start + blockLength <= juce::jmax(length, blockLength); start += hop)
+        {
+            const int num = juce::jmin(blockLength, length - start);
+            double sum = 0.0;
+
+            for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+            {
+                const auto* data = audio.getReadPointer(channel, start);
+
+                for (int i = 0; i < num; ++i)
+                    sum += (double) data[i] * data[i];
+            }
+
+            blocks.push_back(sum / juce::jmax(1, num)); // A file shorter than a block is one short block
+        }
+
+        const auto loudnessOf = [] (double meanSquare) { return -0.691 + 10.0 * std::log10(juce::jmax(1.0e-12, meanSquare)); };
+
+        const auto gatedMean = [&] (double gate)
+        {
+            double sum = 0.0;
+            int count = 0;
+
+            for (auto block : blocks)
+                if (loudnessOf(block) > gate) { sum += block; ++count; }
+
+            return count > 0 ? sum / count : 0.0;
+        };
+
+        const auto absolute = gatedMean(-70.0);
+
+        if (absolute <= 0.0)
+            return -70.0f;
+
+        return (float) loudnessOf(gatedMean(loudnessOf(absolute) - 10.0));
+    }
+
+    //==============================================================================
+    // YIN on frames spread evenly through the sample. The pitch is the median
+    // of the frames that found one, provided most loud frames did.
+    static float measurePitch(const std::vector<float>& mono, double sampleRate)
+    {
+        constexpr int window = 1024;
+        constexpr int numFrames = 32;
+        constexpr float threshold = 0.15f;
+
+        const int minLag = juce::jmax(2, (int) (sampleRate / 1000.0));
+        const int maxLag = juce::jmin(window, (int) (sampleRate / 50.0));
+        const int frameLength = window + maxLag;
+        const int length = (int) mono.size();
+
+        if (length < frameLength || maxLag <= minLag)
+            return 0.0f;
+
+        std::vector<float> difference((size_t) maxLag + 1);
+        std::vector<float> estimates;
+        int loudFrames = 0;
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            const auto* x = mono.data() + (size_t) ((juce::int64) (length - frameLength) * frame / juce::jmax(1, numFrames - 1));
+
+            double energy = 0.0;
+            for (int i = 0; i < window; ++i)
+                energy += (double) x[i] * x[i];
+
+            if (energy / window < 1.0e-5) // Quieter than -50 dB
+                continue;
+
+            ++loudFrames;
+
+            // Cumulative mean normalised difference
+            double runningSum = 0.0;
+            difference[0] = 1.0f;
+
+            for (int lag = 1; lag <= maxLag; ++lag)
+            {
+                double sum = 0.0;
+                for (int i = 0; i < window; ++i)
+                {
+                    const auto d = x[i] - x[i + lag];
+                    sum += (double) d * d;
+                }
+
+                runningSum += sum;
+                difference[(size_t) lag] = runningSum > 0.0 ? (float) (sum * lag / runningSum) : 1.0f;
+            }
+
+            // The first dip under the threshold, followed down to its bottom
+            for (int lag = minLag; lag < maxLag; ++lag)
+            {
+                if (difference[(size_t) lag] < threshold)
+                {
+                    while (lag + 1 < maxLag && difference[(size_t) lag + 1] < difference[(size_t) lag])
+                        ++lag;
+
+                    // Parabolic interpolation between the neighbouring lags
+                    const auto a = difference[(size_t) lag - 1], b = difference[(size_t) lag], c = difference[(size_t) lag + 1];
+                    const auto denominator = a - 2.0f * b + c;
+                    const auto offset = std::abs(denominator) > 1.0e-9f ? 0.5f * (a - c) / denominator : 0.0f;
+                    estimates.push_back((float) (sampleRate / (lag + offset)));
+                    break;
+                }
+            }
+        }
+
+        if (estimates.empty() || (int) estimates.size() * 2 < loudFrames)
+            return 0.0f;
+
+        std::nth_element(estimates.begin(), estimates.begin() + (ptrdiff_t) estimates.size() / 2, estimates.end());
+        return estimates[estimates.size() / 2];
+    }
+
+    //==============================================================================
+    // Magnitude-weighted mean frequency over frames spread through the sample,
+    // louder frames counting for more
+    static float measureCentroid(const std::vector<float>& mono, double sampleRate)
+    {
+        constexpr int order = 11;
+        constexpr int size = 1 << order;
+        constexpr int numFrames = 64;
+
+        const int length = (int) mono.size();
+        juce::dsp::FFT fft(order);
+        juce::dsp::WindowingFunction<float> hann((size_t) size, juce::dsp::WindowingFunction<float>::hann, false);
+        std::vector<float> data((size_t) size * 2);
+        double weightedSum = 0.0, magnitudeSum = 0.0;
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            const int start = length > size ? (int) ((juce::int64) (length - size) * frame / (numFrames - 1)) : 0;
+            const int num = juce::jmin(size, length - start);
+
+            std::fill(data.begin(), data.end(), 0.0f);
+            std::copy(mono.begin() + start, mono.begin() + start + num, data.begin());
+            hann.multiplyWithWindowingTable(data.data(), (size_t) size);
+            fft.performFrequencyOnlyForwardTransform(data.data(), true);
+
+            for (int bin = 1; bin <= size / 2; ++bin)
+            {
+                weightedSum += (double) data[(size_t) bin] * bin;
+                magnitudeSum += data[(size_t) bin];
+            }
+
+            if (length <= size)
+                break;
+        }
+
+        return magnitudeSum > 0.0 ? (float) (weightedSum / magnitudeSum * sampleRate / size) : 0.0f;
+    }
+
+    //==============================================================================
+    void loadCache()
+    {
+        const juce::ScopedLock sl(saveLock);
+        mergeFromFile();
+    }
+
+    // Takes in every entry from the cache file that is missing here or newer
+    // than ours. With saveLock held.
+    void mergeFromFile()
+    {
+        juce::MemoryBlock data;
+
+        if (! cacheFile.loadFileAsData(data))
+            return;
+
+        const auto tree = juce::ValueTree::readFromData(data.getData(), data.getSize());
+
+        if (! tree.hasType("SampleAnalysis") || (int) tree.getProperty("version", 0) != cacheVersion)
+            return; // Written by another version; everything gets analysed again
+
+        const juce::ScopedLock sl(lock);
+
+        for (int i = 0; i < tree.getNumChildren(); ++i)
+        {
+            const auto child = tree.getChild(i);
+            const auto path = child.getProperty("path").toString();
+            Entry entry;
+            entry.modified = juce::Time((juce::int64) child.getProperty("modified"));
+
+            if (entries.contains(path) && entries[path].modified.toMilliseconds() >= entry.modified.toMilliseconds())
+                continue;
+
+            entry.features.durationSeconds = child.getProperty("duration");
+            entry.features.loudness = child.getProperty("loudness");
+            entry.features.pitchHz = child.getProperty("pitch");
+            entry.features.centroidHz = child.getProperty("centroid");
+            entries.set(path, entry);
+            analysed.add(path);
+        }
+    }
+
+    // Any thread. The whole cache is rewritten; it's a few dozen bytes a file.
+    // Whatever another process wrote since we last looked is merged in first.
+    void saveCache()
+    {
+        const juce::ScopedLock sl(saveLock);
+        mergeFromFile();
+
+        juce::ValueTree tree("SampleAnalysis");
+        tree.setProperty("version", cacheVersion, nullptr);
+
+        {
+            const juce::ScopedLock entriesLock(lock);
+
+            for (juce::HashMap<juce::String, Entry>::Iterator i(entries); i.next();)
+            {
+                const auto& entry = i.getValue();
+                juce::ValueTree child("Sample");
+                child.setProperty("path", i.getKey(), nullptr);
+                child.setProperty("modified", entry.modified.toMilliseconds(), nullptr);
+                child.setProperty("duration", entry.features.durationSeconds, nullptr);
+                child.setProperty("loudness", entry.features.loudness, nullptr);
+                child.setProperty("pitch", entry.features.pitchHz, nullptr);
+                child.setProperty("centroid", entry.features.centroidHz, nullptr);
+                tree.appendChild(child, nullptr);
+            }
+        }
+
+        cacheFile.getParentDirectory().createDirectory();
+        juce::TemporaryFile temp(cacheFile);
+
+        if (auto stream = temp.getFile().createOutputStream())
+        {
+            tree.writeToStream(*stream);
+            stream.reset();
+            temp.overwriteTargetFileWithTemporary();
+        }
+    }
+
+    juce::AudioFormatManager formatManager;
+    const juce::File cacheFile;
+    juce::CriticalSection lock, saveLock;
+    juce::HashMap<juce::String, Entry> entries;  // By full path
+    juce::HashMap<juce::String, bool> queued;    // Waiting for or being checked
+    juce::Array<juce::File> queue;               // Files to check, from queueHead on
+    int queueHead = 0, numWorkers = 0;
+    juce::StringArray analysed;                  // Paths in the order their entries were set, for getAnalysedSince()
+    std::atomic<int> numPending { 0 };
+    std::atomic<bool> stopping { false }, unsaved { false };
+    juce::ThreadPool pool; // Last, so its jobs are stopped before anything they use goes away
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleAnalysisIndex)
+};
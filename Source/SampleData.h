@@ -0,0 +1,162 @@
+/*
+  ==============================================================================
+
+    SampleData.h
+    Created: 2 Apr 2024 9:18:44am
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "SpectralMorph.h"
+
+// One sample file as held by the SamplePool, independent of how its audio is
+// kept around (decoded into memory, memory-mapped, ...). Engine snapshots keep
+// a reference, so the data stays alive for as long as a corner plays it.
+//
+// Whatever the granular and spectral modes need on top is built here, once
+// per pooled sample and only when the mode is in use, so every snapshot the
+// sample turns up in shares it.
+class SampleData : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<SampleData>;
+
+    // What a source may use besides the sample itself
+    struct PlaybackContext
+    {
+        juce::TimeSliceThread& readAheadThread; // Shared background thread for disk work
+        std::atomic<int>& streamUnderruns;      // Bumped by the audio thread when streamed data arrives late
+    };
+
+    SampleData(const juce::File& f, juce::Time modified, double rate)
+        : file(f), modificationTime(modified), sampleRate(rate) {}
+
+    // Bytes of our own heap this sample holds, counted against the pool budget
+    virtual size_t getSizeInBytes() const = 0;
+
+    // Creates a source that plays this sample from the start. Called off the
+    // audio thread; the source itself must be safe to read from the audio thread.
+    virtual std::unique_ptr<juce::PositionableAudioSource> createSource(PlaybackContext& context) = 0;
+
+    // What grains read from: a decoded sample's own audio, or the start of a
+    // mapped or streamed one once buildGrainAudio() has run. Null until then.
+    // Any thread.
+    const juce::AudioBuffer<float>* getGrainAudio() const { return grainAudio.load(std::memory_order_acquire); }
+
+    // Pool thread. Decodes the start of the file for the grains, if they have
+    // nothing to read yet. A file that can't be read gets an empty buffer, so
+    // it isn't tried again.
+    void buildGrainAudio(juce::AudioFormatManager& formatManager)
+    {
+        if (getGrainAudio() != nullptr)
+            return;
+
+        readStart(formatManager, grainCache);
+        grainAudio.store(&grainCache, std::memory_order_release);
+    }
+
+    // The spectral morph's frames, or null until buildSpectralFrames() has
+    // run. Any thread.
+    const SpectralFrames* getSpectralFrames() const { return spectralFrames.load(std::memory_order_acquire); }
+
+    // Pool thread. Runs the forward FFTs for the spectral morph, once. Reads
+    // the grains' audio if there is some, otherwise decodes the start of the
+    // file just for this.
+    void buildSpectralFrames(juce::AudioFormatManager& formatManager)
+    {
+        if (getSpectralFrames() != nullptr)
+            return;
+
+        if (auto* audio = getGrainAudio())
+        {
+            spectralCache.analyse(*audio, sampleRate);
+        }
+        else
+        {
+            juce::AudioBuffer<float> start;
+            readStart(formatManager, start);
+            spectralCache.analyse(start, sampleRate);
+        }
+
+        spectralFrames.store(&spectralCache, std::memory_order_release);
+    }
+
+    // Pool thread. Bytes of heap held by what was built for the modes, on top
+    // of getSizeInBytes()
+    size_t getDerivedSizeInBytes() const
+    {
+        size_t total = getGrainAudio() == &grainCache ? getSizeOf(grainCache) : 0;
+
+        if (getSpectralFrames() != nullptr)
+            total += (spectralCache.magnitude.size() + spectralCache.frequency.size()) * sizeof(float);
+
+        return total;
+    }
+
+    // What brings this sample to the target loudness. Unity until the analysis
+    // index has measured the file. Any thread.
+    float getNormalizationGain() const { return normalizationGain.load(std::memory_order_relaxed); }
+    void setNormalizationGain(float gain) { normalizationGain.store(gain, std::memory_order_relaxed); }
+
+    // Longest stretch of a file decoded for the grains or the spectral frames
+    static constexpr double maxDerivedSeconds = SpectralFrames::maxSeconds;
+
+    const juce::File file;
+    const juce::Time modificationTime;
+    const double sampleRate;
+
+protected:
+    static size_t getSizeOf(const juce::AudioBuffer<float>& audio)
+    {
+        return (size_t) audio.getNumChannels() * (size_t) audio.getNumSamples() * sizeof(float);
+    }
+
+    std::atomic<const juce::AudioBuffer<float>*> grainAudio { nullptr };
+
+private:
+    void readStart(juce::AudioFormatManager& formatManager, juce::AudioBuffer<float>& audio) const
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+        if (reader == nullptr)
+            return;
+
+        const auto length = (int) juce::jmin(reader->lengthInSamples, (juce::int64) (reader->sampleRate * maxDerivedSeconds));
+        audio.setSize((int) reader->numChannels, length);
+        reader->read(&audio, 0, length, 0, true, true);
+    }
+
+    juce::AudioBuffer<float> grainCache; // For samples that aren't decoded
+    SpectralFrames spectralCache;
+    std::atomic<const SpectralFrames*> spectralFrames { nullptr };
+    std::atomic<float> normalizationGain { 1.0f };
+};
+
+// A whole file decoded to float
+class DecodedSample : public SampleData
+{
+public:
+    DecodedSample(const juce::File& f, juce::Time modified, double rate)
+        : SampleData(f, modified, rate)
+    {
+        grainAudio.store(&audio); // Grains read straight from the decoded audio
+    }
+
+    size_t getSizeInBytes() const override
+    {
+        return getSizeOf(audio);
+    }
+
+    std::unique_ptr<juce::PositionableAudioSource> createSource(PlaybackContext&) override
+    {
+        // Plays straight out of this buffer, without copying it
+        return std::make_unique<juce::MemoryAudioSource>(audio, false);
+    }
+
+    juce::AudioBuffer<float> audio;
+};
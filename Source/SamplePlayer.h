@@ -0,0 +1,388 @@
+/*
+  ==============================================================================
+
+    SamplePlayer.h
+    Created: 7 May 2024 6:22:37pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+// Plays a source at a fractional rate (source frames per output frame).
+//
+// Frames are pulled from the source into a small staging buffer that keeps a
+// few frames of history, and read from there with linear, cubic Hermite or
+// 16-tap windowed-sinc interpolation. Nothing is rebuilt when the pitch
+// changes: setRate() is a single atomic store, picked up at the next block.
+class SamplePlayer
+{
+public:
+    enum class Interpolation { linear, hermite, sinc };
+
+    static constexpr int sincTaps = 16;
+    static constexpr int sincPhases = 256;
+    static constexpr int historyFrames = sincTaps / 2 - 1;   // Frames needed before the read position
+    static constexpr int lookAheadFrames = sincTaps / 2;     // And after it
+
+    SamplePlayer() = default;
+
+    // Off the audio thread. highestRate bounds setRate(), so the staging
+    // buffer never has to grow.
+    void prepare(juce::PositionableAudioSource* sourceToUse, int numChannels, int maximumBlockSize, double highestRate)
+    {
+        source = sourceToUse;
+        maximumRate = highestRate;
+        capacity = (int) std::ceil(maximumBlockSize * maximumRate) + sincTaps + 2;
+        staging.setSize(juce::jmax(1, numChannels), capacity);
+        getSincTables(); // Builds the shared tables here rather than on the audio thread
+        restart();
+    }
+
+    // Any thread
+    void setRate(double newRate) noexcept                    { rate.store(juce::jlimit(0.0, maximumRate, newRate), std::memory_order_relaxed); }
+    double getRate() const noexcept                          { return rate.load(std::memory_order_relaxed); }
+    void setInterpolation(Interpolation newInterpolation) noexcept { interpolation.store(newInterpolation, std::memory_order_relaxed); }
+
+    // Audio thread. Back to the first frame of the source, with silence before it.
+    void restart() noexcept
+    {
+        if (source != nullptr)
+            source->setNextReadPosition(0);
+
+        staging.clear(0, historyFrames);
+        stagingStart = -historyFrames;
+        stagingCount = historyFrames;
+        position = 0.0;
+    }
+
+    bool hasReachedEnd() const noexcept
+    {
+        return source == nullptr || position >= (double) source->getTotalLength();
+    }
+
+    // Audio thread. How far through the source the read position is, 0 to 1.
+    double getProportionPlayed() const noexcept
+    {
+        const auto length = source != nullptr ? source->getTotalLength() : 0;
+        return length > 0 ? juce::jlimit(0.0, 1.0, position / (double) length) : 0.0;
+    }
+
+    // Audio thread. Replaces numSamples frames of dest, starting at destStart.
+    // numSamples must not be more than the block size given to prepare().
+    void process(juce::AudioBuffer<float>& dest, int destStart, int numSamples) noexcept
+    {
+        const double step = rate.load(std::memory_order_relaxed);
+        const auto mode = interpolation.load(std::memory_order_relaxed);
+
+        // Let go of what is no longer needed as history...
+        const auto firstFrame = (juce::int64) std::floor(position);
+        const auto shift = (int) juce::jlimit((juce::int64) 0, (juce::int64) stagingCount, firstFrame - historyFrames - stagingStart);
+
+        if (shift > 0)
+        {
+            for (int channel = 0; channel < staging.getNumChannels(); ++channel)
+            {
+                auto* data = staging.getWritePointer(channel);
+                std::memmove(data, data + shift, sizeof(float) * (size_t) (stagingCount - shift));
+            }
+
+            stagingStart += shift;
+            stagingCount -= shift;
+        }
+
+        // ...and pull in everything this block will read
+        const auto lastFrame = (juce::int64) std::floor(position + (numSamples - 1) * step);
+        auto needed = (int) (lastFrame + lookAheadFrames + 1 - (stagingStart + stagingCount));
+        jassert(stagingCount + needed <= capacity); // Rate or block size above what prepare() was told
+        needed = juce::jmin(needed, capacity - stagingCount);
+
+        if (needed > 0 && source != nullptr)
+        {
+            source->getNextAudioBlock(juce::AudioSourceChannelInfo(&staging, stagingCount, needed));
+            stagingCount += needed;
+        }
+
+        const double start = position - (double) stagingStart;
+
+        for (int channel = 0; channel < dest.getNumChannels(); ++channel)
+        {
+            const auto* in = staging.getReadPointer(channel % staging.getNumChannels());
+            auto* out = dest.getWritePointer(channel, destStart);
+
+            switch (mode)
+            {
+                case Interpolation::linear:  interpolateLinear(in, start, step, out, numSamples);  break;
+                case Interpolation::hermite: interpolateHermite(in, start, step, out, numSamples); break;
+                case Interpolation::sinc:    interpolateSinc(in, start, step, out, numSamples);    break;
+            }
+        }
+
+        position += numSamples * step;
+    }
+
+private:
+    //==============================================================================
+    // Blackman-windowed sinc, one row of sincTaps coefficients per fractional
+    // position. Row p is for a read position p / sincPhases of the way from
+    // one frame to the next; there is one extra row so p + 1 always exists.
+    // cutoff is a fraction of the source's Nyquist frequency.
+    struct SincTable
+    {
+        void build(double cutoff)
+        {
+            constexpr double halfWidth = sincTaps / 2;
+
+            for (int p = 0; p <= sincPhases; ++p)
+            {
+                const double fraction = (double) p / sincPhases;
+                double sum = 0.0;
+
+                for (int t = 0; t < sincTaps; ++t)
+                {
+                    const double x = (t - historyFrames) - fraction;
+                    const double sinc = x == 0.0 ? 1.0 : std::sin(juce::MathConstants<double>::pi * cutoff * x)
+                                                          / (juce::MathConstants<double>::pi * cutoff * x);
+                    const double w = (x + halfWidth) / (2.0 * halfWidth);
+                    const double window = 0.42 - 0.5 * std::cos(2.0 * juce::MathConstants<double>::pi * w)
+                                               + 0.08 * std::cos(4.0 * juce::MathConstants<double>::pi * w);
+                    coefficients[p][t] = (float) (sinc * window);
+                    sum += sinc * window;
+                }
+
+                // Unity gain at DC for every phase. This also scales the kernel
+                // down by the cutoff, which would otherwise raise the gain.
+                for (int t = 0; t < sincTaps; ++t)
+                    coefficients[p][t] = (float) (coefficients[p][t] / sum);
+            }
+        }
+
+        alignas(16) float coefficients[sincPhases + 1][sincTaps];
+    };
+
+    // One table per third of an octave of rate, from 1 up to 16. Reading
+    // faster than 1 would fold everything above the output's Nyquist
+    // frequency back down, so each table's cutoff is a little under the
+    // source's Nyquist divided by the highest rate it is used for.
+    static constexpr int numSincTables = 13;
+    static constexpr int sincTablesPerOctave = 3;
+
+    struct SincTables
+    {
+        SincTables()
+        {
+            for (int i = 0; i < numSincTables; ++i)
+                tables[i].build(0.9 * std::pow(2.0, -(double) i / sincTablesPerOctave));
+        }
+
+        SincTable tables[numSincTables];
+    };
+
+    static const SincTables& getSincTables()
+    {
+        static const SincTables tables;
+        return tables;
+    }
+
+    // The table for a rate, rounding up to the next band so the cutoff errs low
+    static const SincTable& getSincTable(double rate)
+    {
+        const auto band = rate > 1.0 ? (int) std::ceil(std::log2(rate) * sincTablesPerOctave - 1.0e-9) : 0;
+        return getSincTables().tables[juce::jlimit(0, numSincTables - 1, band)];
+    }
+
+    //==============================================================================
+    // Every interpolator reads in[] around in + start + i * step. Where it
+    // pays off, four output frames are worked out at once, each with its own
+    // set of input frames.
+    static void interpolateLinear(const float* in, double start, double step, float* out, int numSamples) noexcept
+    {
+        int i = 0;
+
+       #if JUCE_USE_SSE_INTRINSICS || JUCE_USE_ARM_NEON
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            alignas(16) float x0[4], x1[4], f[4];
+
+            for (int k = 0; k < 4; ++k)
+            {
+                const double p = start + (i + k) * step;
+                const auto index = (int) p;
+                x0[k] = in[index];
+                x1[k] = in[index + 1];
+                f[k] = (float) (p - index);
+            }
+
+           #if JUCE_USE_SSE_INTRINSICS
+            const auto a = _mm_load_ps(x0);
+            _mm_storeu_ps(out + i, _mm_add_ps(a, _mm_mul_ps(_mm_load_ps(f), _mm_sub_ps(_mm_load_ps(x1), a))));
+           #else
+            const auto a = vld1q_f32(x0);
+            vst1q_f32(out + i, vmlaq_f32(a, vld1q_f32(f), vsubq_f32(vld1q_f32(x1), a)));
+           #endif
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+        {
+            const double p = start + i * step;
+            const auto index = (int) p;
+            const auto f = (float) (p - index);
+            out[i] = in[index] + f * (in[index + 1] - in[index]);
+        }
+    }
+
+    // 4-point, 3rd-order Hermite (Catmull-Rom)
+    static void interpolateHermite(const float* in, double start, double step, float* out, int numSamples) noexcept
+    {
+        int i = 0;
+
+       #if JUCE_USE_SSE_INTRINSICS
+        const auto half = _mm_set1_ps(0.5f), oneAndHalf = _mm_set1_ps(1.5f);
+        const auto two = _mm_set1_ps(2.0f), twoAndHalf = _mm_set1_ps(2.5f);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            alignas(16) float xm1[4], x0[4], x1[4], x2[4], f[4];
+
+            for (int k = 0; k < 4; ++k)
+            {
+                const double p = start + (i + k) * step;
+                const auto index = (int) p;
+                xm1[k] = in[index - 1];
+                x0[k] = in[index];
+                x1[k] = in[index + 1];
+                x2[k] = in[index + 2];
+                f[k] = (float) (p - index);
+            }
+
+            const auto a = _mm_load_ps(xm1), b = _mm_load_ps(x0), c = _mm_load_ps(x1), d = _mm_load_ps(x2);
+            const auto t = _mm_load_ps(f);
+
+            const auto c1 = _mm_mul_ps(half, _mm_sub_ps(c, a));
+            const auto c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(a, _mm_mul_ps(twoAndHalf, b)), _mm_mul_ps(two, c)), _mm_mul_ps(half, d));
+            const auto c3 = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(d, a)), _mm_mul_ps(oneAndHalf, _mm_sub_ps(b, c)));
+
+            const auto y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, t), c2), t), c1), t), b);
+            _mm_storeu_ps(out + i, y);
+        }
+       #elif JUCE_USE_ARM_NEON
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            alignas(16) float xm1[4], x0[4], x1[4], x2[4], f[4];
+
+            for (int k = 0; k < 4; ++k)
+            {
+                const double p = start + (i + k) * step;
+                const auto index = (int) p;
+                xm1[k] = in[index - 1];
+                x0[k] = in[index];
+                x1[k] = in[index + 1];
+                x2[k] = in[index + 2];
+                f[k] = (float) (p - index);
+            }
+
+            const auto a = vld1q_f32(xm1), b = vld1q_f32(x0), c = vld1q_f32(x1), d = vld1q_f32(x2);
+            const auto t = vld1q_f32(f);
+
+            const auto c1 = vmulq_n_f32(vsubq_f32(c, a), 0.5f);
+            const auto c2 = vsubq_f32(vmlaq_n_f32(vmlsq_n_f32(a, b, 2.5f), c, 2.0f), vmulq_n_f32(d, 0.5f));
+            const auto c3 = vmlaq_n_f32(vmulq_n_f32(vsubq_f32(d, a), 0.5f), vsubq_f32(b, c), 1.5f);
+
+            vst1q_f32(out + i, vmlaq_f32(b, vmlaq_f32(c1, vmlaq_f32(c2, c3, t), t), t));
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+        {
+            const double p = start + i * step;
+            const auto index = (int) p;
+            const auto t = (float) (p - index);
+            const float a = in[index - 1], b = in[index], c = in[index + 1], d = in[index + 2];
+
+            const float c1 = 0.5f * (c - a);
+            const float c2 = a - 2.5f * b + 2.0f * c - 0.5f * d;
+            const float c3 = 0.5f * (d - a) + 1.5f * (b - c);
+            out[i] = ((c3 * t + c2) * t + c1) * t + b;
+        }
+    }
+
+    // Each output frame is a 16-tap dot product, vectorised across the taps.
+    // The coefficients are interpolated between the two nearest table rows.
+    static void interpolateSinc(const float* in, double start, double step, float* out, int numSamples) noexcept
+    {
+        const auto& table = getSincTable(step);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const double p = start + i * step;
+            const auto index = (int) p;
+            const double phase = (p - index) * sincPhases;
+            const auto row = juce::jmin((int) phase, sincPhases - 1);
+            const auto blend = (float) (phase - row);
+
+            const float* taps = in + index - historyFrames;
+            const float* h0 = table.coefficients[row];
+            const float* h1 = table.coefficients[row + 1];
+
+           #if JUCE_USE_SSE_INTRINSICS
+            const auto b = _mm_set1_ps(blend);
+            auto sum = _mm_setzero_ps();
+
+            for (int t = 0; t < sincTaps; t += 4)
+            {
+                const auto a = _mm_load_ps(h0 + t);
+                const auto h = _mm_add_ps(a, _mm_mul_ps(b, _mm_sub_ps(_mm_load_ps(h1 + t), a)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(h, _mm_loadu_ps(taps + t)));
+            }
+
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+            out[i] = _mm_cvtss_f32(sum);
+           #elif JUCE_USE_ARM_NEON
+            auto sum = vdupq_n_f32(0.0f);
+
+            for (int t = 0; t < sincTaps; t += 4)
+            {
+                const auto a = vld1q_f32(h0 + t);
+                const auto h = vmlaq_n_f32(a, vsubq_f32(vld1q_f32(h1 + t), a), blend);
+                sum = vmlaq_f32(sum, h, vld1q_f32(taps + t));
+            }
+
+            const auto pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+            out[i] = vget_lane_f32(vpadd_f32(pair, pair), 0);
+           #else
+            float sum = 0.0f;
+
+            for (int t = 0; t < sincTaps; ++t)
+                sum += (h0[t] + blend * (h1[t] - h0[t])) * taps[t];
+
+            out[i] = sum;
+           #endif
+        }
+    }
+
+    //==============================================================================
+    juce::PositionableAudioSource* source = nullptr;
+    juce::AudioBuffer<float> staging;
+    int capacity = 0;
+    juce::int64 stagingStart = 0; // Source frame held at staging index 0
+    int stagingCount = 0;
+    double position = 0.0; // Read position in source frames
+    double maximumRate = 1.0;
+
+    std::atomic<double> rate { 1.0 };
+    std::atomic<Interpolation> interpolation { Interpolation::hermite };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplePlayer)
+};
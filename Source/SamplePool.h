@@ -0,0 +1,289 @@
+/*
+  ==============================================================================
+
+    SamplePool.h
+    Created: 21 Mar 2024 4:37:02pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include "SampleData.h"
+#include "MappedSample.h"
+#include "StreamedSample.h"
+
+// Keeps recently used samples ready to play, up to a byte budget, and loads
+// them on a background thread so the message and audio threads never touch
+// the disk. Depending on the load mode a sample is decoded into memory,
+// memory-mapped (PCM WAV/AIFF only) or streamed from disk behind a short
+// resident head.
+//
+// requestSet() is for files that should play as soon as possible; the most
+// recent request wins. prefetch() queues files that are likely to be asked
+// for next (e.g. the upcoming Dice picks) and is served when idle. In between,
+// the set last handed over gets whatever the modes in use need built for it:
+// the grains' audio, the spectral frames.
+class SamplePool : private juce::Thread
+{
+public:
+    enum class LoadMode
+    {
+        decoded,
+        memoryMapped,
+        streamed
+    };
+
+    using SetReadyCallback = std::function<void(const juce::Array<SampleData::Ptr>&)>;
+
+    SamplePool(juce::AudioFormatManager& manager, SetReadyCallback callback)
+        : juce::Thread("Specter sample pool"), formatManager(manager), onSetReady(std::move(callback))
+    {
+        startThread(juce::Thread::Priority::normal);
+    }
+
+    ~SamplePool() override
+    {
+        stopThread(4000);
+    }
+
+    void setMemoryBudget(size_t numBytes) { memoryBudget.store(numBytes); }
+    size_t getMemoryBudget() const { return memoryBudget.load(); }
+
+    // Applies to samples loaded from now on; cached ones of the other kind are
+    // replaced as they are asked for again.
+    void setLoadMode(LoadMode newMode) { loadMode.store(newMode); }
+    LoadMode getLoadMode() const { return loadMode.load(); }
+
+    // How much of each streamed sample stays in memory
+    void setStreamingHeadMilliseconds(double ms) { streamingHeadMs.store(ms); }
+
+    // Any thread. Whether the samples being played need audio for the grains.
+    // Once built it stays with the pooled sample.
+    void setWantsGrainAudio(bool shouldBuild)
+    {
+        if (wantsGrainAudio.exchange(shouldBuild) != shouldBuild)
+            notify();
+    }
+
+    // Any thread. The same for the spectral morph's frames.
+    void setWantsSpectralFrames(bool shouldBuild)
+    {
+        if (wantsSpectralFrames.exchange(shouldBuild) != shouldBuild)
+            notify();
+    }
+
+    // Any thread. Replaces a request that has not been served yet.
+    void requestSet(const juce::Array<juce::File>& files)
+    {
+        {
+            const juce::ScopedLock sl(queueLock);
+            requestedFiles = files;
+            hasRequest = true;
+        }
+
+        notify();
+    }
+
+    // Any thread. Files already decoded or already queued are skipped.
+    void prefetch(const juce::Array<juce::File>& files)
+    {
+        {
+            const juce::ScopedLock sl(queueLock);
+
+            for (auto& f : files)
+                prefetchQueue.addIfNotAlreadyThere(f);
+
+            // Only the newest guesses are worth decoding
+            while (prefetchQueue.size() > maxQueuedPrefetches)
+                prefetchQueue.remove(0);
+        }
+
+        notify();
+    }
+
+private:
+    struct Entry
+    {
+        SampleData::Ptr sample;
+        LoadMode mode;
+    };
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            juce::Array<juce::File> filesToLoad, fileToPrefetch;
+            bool serveRequest = false;
+
+            {
+                const juce::ScopedLock sl(queueLock);
+
+                if (hasRequest)
+                {
+                    filesToLoad.swapWith(requestedFiles);
+                    hasRequest = false;
+                    serveRequest = true;
+                }
+            }
+
+            if (serveRequest)
+            {
+                juce::Array<SampleData::Ptr> samples;
+
+                for (auto& f : filesToLoad)
+                    samples.add(getOrLoad(f));
+
+                onSetReady(samples);
+                currentSet = samples;
+                continue;
+            }
+
+            // What is playing comes before guesses at what might play next
+            if (buildForCurrentSet())
+                continue;
+
+            {
+                const juce::ScopedLock sl(queueLock);
+
+                if (! prefetchQueue.isEmpty())
+                {
+                    fileToPrefetch.add(prefetchQueue.getFirst());
+                    prefetchQueue.remove(0);
+                }
+            }
+
+            if (! fileToPrefetch.isEmpty())
+                getOrLoad(fileToPrefetch.getFirst());
+            else
+                wait(-1);
+        }
+    }
+
+    // Pool thread only. Builds one thing the current set is missing for the
+    // modes in use. Returns false if it has everything.
+    bool buildForCurrentSet()
+    {
+        for (auto& sample : currentSet)
+        {
+            if (sample == nullptr)
+                continue;
+
+            if (wantsGrainAudio.load() && sample->getGrainAudio() == nullptr)
+                sample->buildGrainAudio(formatManager);
+            else if (wantsSpectralFrames.load() && sample->getSpectralFrames() == nullptr)
+                sample->buildSpectralFrames(formatManager);
+            else
+                continue;
+
+            evictToBudget();
+            return true;
+        }
+
+        return false;
+    }
+
+    // Pool thread only
+    SampleData::Ptr getOrLoad(const juce::File& file)
+    {
+        const auto modified = file.getLastModificationTime();
+        const auto mode = loadMode.load();
+
+        for (int i = 0; i < entries.size(); ++i)
+        {
+            auto entry = entries.getReference(i);
+
+            if (entry.sample->file != file)
+                continue;
+
+            entries.remove(i);
+
+            if (entry.sample->modificationTime != modified || entry.mode != mode)
+                break; // The file changed on disk or the mode changed, load it again
+
+            entries.add(entry); // Most recently used goes last
+            return entry.sample;
+        }
+
+        SampleData::Ptr sample;
+
+        if (mode == LoadMode::memoryMapped)
+            sample = MappedSample::create(formatManager, file, modified);
+        else if (mode == LoadMode::streamed)
+            sample = StreamedSample::create(formatManager, file, modified, streamingHeadMs.load());
+
+        if (sample == nullptr)
+            sample = decode(file, modified);
+
+        if (sample != nullptr)
+        {
+            entries.add({ sample, mode });
+            evictToBudget();
+        }
+
+        return sample;
+    }
+
+    SampleData::Ptr decode(const juce::File& file, juce::Time modified)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+        if (reader == nullptr || reader->lengthInSamples <= 0
+             || reader->lengthInSamples > std::numeric_limits<int>::max())
+            return nullptr;
+
+        juce::ReferenceCountedObjectPtr<DecodedSample> sample = new DecodedSample(file, modified, reader->sampleRate);
+        sample->audio.setSize((int) reader->numChannels, (int) reader->lengthInSamples);
+        reader->read(&sample->audio, 0, (int) reader->lengthInSamples, 0, true, true);
+        return sample.get();
+    }
+
+    // Drops least recently used samples nobody else is holding on to. Mapped
+    // samples cost no heap but each holds a file open, so their number is capped too.
+    void evictToBudget()
+    {
+        size_t total = 0;
+
+        for (auto& e : entries)
+            total += e.sample->getSizeInBytes() + e.sample->getDerivedSizeInBytes();
+
+        const auto budget = memoryBudget.load();
+
+        for (int i = 0; i < entries.size() && (total > budget || entries.size() > maxCachedFiles);)
+        {
+            auto& sample = entries.getReference(i).sample;
+
+            if (sample->getReferenceCount() > 1)
+            {
+                ++i; // Still playing in an engine snapshot
+                continue;
+            }
+
+            total -= sample->getSizeInBytes() + sample->getDerivedSizeInBytes();
+            entries.remove(i);
+        }
+    }
+
+    static constexpr int maxQueuedPrefetches = 16;
+    static constexpr int maxCachedFiles = 256;
+
+    juce::AudioFormatManager& formatManager;
+    SetReadyCallback onSetReady;
+    std::atomic<size_t> memoryBudget { (size_t) 512 * 1024 * 1024 };
+    std::atomic<LoadMode> loadMode { LoadMode::decoded };
+    std::atomic<double> streamingHeadMs { 500.0 };
+    std::atomic<bool> wantsGrainAudio { false }, wantsSpectralFrames { false };
+
+    juce::CriticalSection queueLock;
+    juce::Array<juce::File> requestedFiles, prefetchQueue;
+    bool hasRequest = false;
+
+    juce::Array<Entry> entries; // Least recently used first
+    juce::Array<SampleData::Ptr> currentSet; // The last set handed over, pool thread only
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplePool)
+};
@@ -0,0 +1,350 @@
+/*
+  ==============================================================================
+
+    SpectralMorph.h
+    Created: 9 May 2024 9:02:27pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+
+// The short-time spectrum of one sample, worked out once per pooled sample
+// when the spectral morph is first used: for every analysis frame, the
+// magnitude of each bin and the true frequency of whatever is in it, measured
+// in bins from the phase change between frames. Mono; the channels are summed
+// before the analysis.
+struct SpectralFrames
+{
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int numBins = fftSize / 2 + 1;
+    static constexpr int hopSize = fftSize / 4;
+
+    // Longest stretch of a sample that is analysed. At eight bytes a bin the
+    // frames take four times the memory of the same audio in mono.
+    static constexpr double maxSeconds = 30.0;
+
+    int numFrames = 0;
+    double sampleRate = 44100.0;
+    std::vector<float> magnitude; // [frame * numBins + bin]
+    std::vector<float> frequency; // Same layout, in bins
+
+    const float* getMagnitudes(int frame) const { return magnitude.data() + (size_t) frame * numBins; }
+    const float* getFrequencies(int frame) const { return frequency.data() + (size_t) frame * numBins; }
+
+    // Off the audio thread. Slow; runs one forward FFT per hop.
+    void analyse(const juce::AudioBuffer<float>& audio, double fileSampleRate)
+    {
+        sampleRate = fileSampleRate;
+        const int length = juce::jmin(audio.getNumSamples(), (int) (fileSampleRate * maxSeconds));
+        numFrames = length > 0 ? length / hopSize + 1 : 0;
+
+        magnitude.assign((size_t) numFrames * numBins, 0.0f);
+        frequency.assign((size_t) numFrames * numBins, 0.0f);
+
+        if (numFrames == 0 || audio.getNumChannels() == 0)
+            return;
+
+        juce::dsp::FFT fft(fftOrder);
+        const auto& window = getWindow();
+        std::vector<float> data((size_t) fftSize * 2);
+        std::vector<float> lastPhase((size_t) numBins, 0.0f);
+        const float channelGain = 1.0f / (float) audio.getNumChannels();
+        const double expectedAdvance = juce::MathConstants<double>::twoPi * hopSize / fftSize;
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            // Frames are centred on their hop, so the first one starts half a window early
+            const int start = frame * hopSize - fftSize / 2;
+            std::fill(data.begin(), data.end(), 0.0f);
+
+            for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+            {
+                const auto* source = audio.getReadPointer(channel);
+
+                for (int i = juce::jmax(0, -start); i < fftSize && start + i < length; ++i)
+                    data[(size_t) i] += source[start + i] * channelGain * window[(size_t) i];
+            }
+
+            fft.performRealOnlyForwardTransform(data.data(), true);
+
+            auto* mags = magnitude.data() + (size_t) frame * numBins;
+            auto* freqs = frequency.data() + (size_t) frame * numBins;
+
+            for (int bin = 0; bin < numBins; ++bin)
+            {
+                const auto re = data[(size_t) bin * 2], im = data[(size_t) bin * 2 + 1];
+                const auto phase = std::atan2(im, re);
+                mags[bin] = std::sqrt(re * re + im * im);
+
+                // How far the phase moved beyond what the bin's centre would
+                // have, wrapped to +-pi, gives the offset from the centre
+                auto deviation = phase - lastPhase[(size_t) bin] - bin * expectedAdvance;
+                deviation -= juce::MathConstants<double>::twoPi * std::round(deviation / juce::MathConstants<double>::twoPi);
+                freqs[bin] = (float) (bin + deviation / expectedAdvance);
+                lastPhase[(size_t) bin] = phase;
+            }
+        }
+
+        // The first frame has nothing before it to measure against
+        if (numFrames > 1)
+            std::copy(frequency.begin() + numBins, frequency.begin() + 2 * numBins, frequency.begin());
+    }
+
+    // Periodic Hann, used for analysis and again for resynthesis
+    static const std::vector<float>& getWindow()
+    {
+        static const std::vector<float> window = []
+        {
+            std::vector<float> table((size_t) fftSize);
+
+            for (int i = 0; i < fftSize; ++i)
+                table[(size_t) i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float) i / (float) fftSize);
+
+            return table;
+        }();
+
+        return window;
+    }
+};
+
+// Plays the corners by morphing between their spectra instead of crossfading
+// the audio. Every hop the frames under a voice's playhead are blended with
+// the XY pad's weights: magnitudes are summed, and each bin's frequency is
+// the magnitude-weighted average of the corners', so the blend glides
+// between partials rather than beating between them. The phases then advance
+// by those frequencies, and one inverse FFT per hop, overlap-added, gives
+// the output.
+//
+// A note shifts the spectrum up or down by moving bins, with the playhead
+// running at normal speed, so notes change pitch without changing length.
+// The corners' own sample rates are folded into the same shift.
+class SpectralMorph
+{
+public:
+    static constexpr int numCorners = 4;
+    static constexpr int fftSize = SpectralFrames::fftSize;
+    static constexpr int numBins = SpectralFrames::numBins;
+    static constexpr int hopSize = SpectralFrames::hopSize;
+
+    // One voice's place in the morph. Allocates in prepare(), never after.
+    struct Stream
+    {
+        void prepare()
+        {
+            phase.assign((size_t) numBins, 0.0f);
+            overlap.assign((size_t) fftSize, 0.0f);
+            reset();
+        }
+
+        void reset()
+        {
+            position = 0.0;
+            samplesLeftInHop = 0;
+            std::fill(phase.begin(), phase.end(), 0.0f);
+            std::fill(overlap.begin(), overlap.end(), 0.0f);
+        }
+
+        double position = 0.0;    // Playhead, in seconds into the samples
+        int samplesLeftInHop = 0; // Output still to be read from the front of overlap
+        std::vector<float> phase;
+        std::vector<float> overlap;
+    };
+
+    SpectralMorph() : fft(SpectralFrames::fftOrder) {}
+
+    // Allocates. Call before rendering, off the audio thread.
+    void prepare(double sampleRate)
+    {
+        deviceSampleRate = sampleRate;
+        data.assign((size_t) fftSize * 2, 0.0f);
+        binMagnitude.assign((size_t) numBins, 0.0f);
+        binFrequency.assign((size_t) numBins, 0.0f);
+        peaks.assign((size_t) numBins, 0);
+        SpectralFrames::getWindow(); // Builds the table here rather than on the audio thread
+    }
+
+    // Writes the next numSamples of one stream into output. frames has an
+    // entry per corner, null where there is nothing to morph with.
+    void render(const SpectralFrames* const* frames, Stream& stream, float* output, int numSamples,
+                double pitchRatio, const float* cornerWeights, bool looping)
+    {
+        for (int done = 0; done < numSamples;)
+        {
+            if (stream.samplesLeftInHop == 0)
+            {
+                synthesiseFrame(frames, stream, pitchRatio, cornerWeights, looping);
+                stream.samplesLeftInHop = hopSize;
+            }
+
+            const int num = juce::jmin(numSamples - done, stream.samplesLeftInHop);
+            juce::FloatVectorOperations::copy(output + done, stream.overlap.data() + (hopSize - stream.samplesLeftInHop), num);
+            stream.samplesLeftInHop -= num;
+            done += num;
+        }
+    }
+
+    // True once the playhead and the tail of the last frame are past the end
+    // of every corner, for when the samples don't loop
+    static bool hasReachedEnd(const SpectralFrames* const* frames, const Stream& stream)
+    {
+        for (int c = 0; c < numCorners; ++c)
+            if (frames[c] != nullptr
+                 && stream.position * frames[c]->sampleRate < (double) (frames[c]->numFrames * hopSize + fftSize))
+                return false;
+
+        return true;
+    }
+
+private:
+    // Hann squared, overlapped four times, sums to 1.5
+    static constexpr float overlapGain = 1.0f / 1.5f;
+
+    void synthesiseFrame(const SpectralFrames* const* frames, Stream& stream, double pitchRatio,
+                         const float* cornerWeights, bool looping)
+    {
+        std::fill(binMagnitude.begin(), binMagnitude.end(), 0.0f);
+        std::fill(binFrequency.begin(), binFrequency.end(), 0.0f);
+
+        for (int c = 0; c < numCorners; ++c)
+        {
+            const auto* corner = frames[c];
+
+            if (corner == nullptr || corner->numFrames == 0 || cornerWeights[c] <= 0.0f)
+                continue;
+
+            auto frame = (int) (stream.position * corner->sampleRate / hopSize);
+
+            if (frame >= corner->numFrames)
+            {
+                if (! looping)
+                    continue;
+
+                frame %= corner->numFrames;
+            }
+
+            addCorner(corner->getMagnitudes(frame), corner->getFrequencies(frame), cornerWeights[c],
+                      (float) (pitchRatio * corner->sampleRate / deviceSampleRate));
+        }
+
+        // Only the peaks keep a running phase, advanced by their blended
+        // frequency. The bins around a peak are locked to it half a turn
+        // apart from one another, which is how a steady partial looks through
+        // the window, so each partial stays centred in the frame however its
+        // frequency was measured or moved.
+        const auto advance = juce::MathConstants<float>::twoPi * (float) hopSize / (float) fftSize;
+        auto& phases = stream.phase;
+
+        forEachBinByPeak(binMagnitude.data(), [&] (int bin, int peak)
+        {
+            if (bin == peak)
+            {
+                const auto freq = binFrequency[(size_t) peak] / binMagnitude[(size_t) peak];
+                const auto phase = phases[(size_t) peak] + advance * freq;
+                phases[(size_t) peak] = phase - juce::MathConstants<float>::twoPi * std::floor(phase / juce::MathConstants<float>::twoPi);
+            }
+        });
+
+        forEachBinByPeak(binMagnitude.data(), [&] (int bin, int peak)
+        {
+            if (bin != peak)
+                phases[(size_t) bin] = phases[(size_t) peak] + ((bin - peak) & 1 ? juce::MathConstants<float>::pi : 0.0f);
+        });
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            const auto mag = binMagnitude[(size_t) bin];
+            data[(size_t) bin * 2] = mag * std::cos(phases[(size_t) bin]);
+            data[(size_t) bin * 2 + 1] = mag * std::sin(phases[(size_t) bin]);
+        }
+
+        // DC and Nyquist have no phase of their own in a real signal
+        data[1] = 0.0f;
+        data[(size_t) (numBins - 1) * 2 + 1] = 0.0f;
+
+        fft.performRealOnlyInverseTransform(data.data());
+
+        // Slide the overlap along by a hop and add the new frame, windowed again
+        auto* overlap = stream.overlap.data();
+        std::copy(overlap + hopSize, overlap + fftSize, overlap);
+        std::fill(overlap + fftSize - hopSize, overlap + fftSize, 0.0f);
+
+        juce::FloatVectorOperations::multiply(data.data(), SpectralFrames::getWindow().data(), fftSize);
+        juce::FloatVectorOperations::addWithMultiply(overlap, data.data(), overlapGain, fftSize);
+
+        stream.position += hopSize / deviceSampleRate;
+    }
+
+    // Adds one corner's frame into the blend, shifted up or down by ratio.
+    // binFrequency holds the sums of frequency times magnitude until the end.
+    void addCorner(const float* mags, const float* freqs, float weight, float ratio)
+    {
+        if (std::abs(ratio - 1.0f) < 1.0e-6f)
+        {
+            juce::FloatVectorOperations::addWithMultiply(binMagnitude.data(), mags, weight, numBins);
+
+            for (int bin = 0; bin < numBins; ++bin)
+                binFrequency[(size_t) bin] += weight * mags[bin] * freqs[bin];
+
+            return;
+        }
+
+        // Each bin moves by as much as the peak it belongs to, so every
+        // partial keeps the shape of its peak. The shift comes from the
+        // peak's measured frequency, and a fractional shift is split between
+        // the two nearest bins.
+        forEachBinByPeak(mags, [&] (int bin, int peak)
+        {
+            const auto target = bin + freqs[peak] * (ratio - 1.0f);
+            const auto index = (int) std::floor(target);
+            const auto frac = target - (float) index;
+
+            if (index < 0 || index >= numBins - 1)
+                return;
+
+            const auto mag = weight * mags[bin];
+            const auto freq = freqs[bin] * ratio;
+            binMagnitude[(size_t) index] += mag * (1.0f - frac);
+            binMagnitude[(size_t) index + 1] += mag * frac;
+            binFrequency[(size_t) index] += mag * (1.0f - frac) * freq;
+            binFrequency[(size_t) index + 1] += mag * frac * freq;
+        });
+    }
+
+    // Calls fn(bin, peak) for every bin with the spectral peak it belongs
+    // to. A peak owns the bins out to the lowest points either side of it.
+    template <typename Fn>
+    void forEachBinByPeak(const float* mags, Fn&& fn)
+    {
+        int numPeaks = 0;
+
+        for (int bin = 1; bin < numBins - 1; ++bin)
+            if (mags[bin] > mags[bin - 1] && mags[bin] >= mags[bin + 1])
+                peaks[(size_t) numPeaks++] = bin;
+
+        for (int bin = 0, peak = 0; bin < numBins && numPeaks > 0; ++bin)
+        {
+            // Rising again after the trough past this peak, so on to the next
+            while (peak + 1 < numPeaks && bin > peaks[(size_t) peak]
+                   && mags[bin] > mags[bin - 1] && bin <= peaks[(size_t) peak + 1])
+                ++peak;
+
+            fn(bin, peaks[(size_t) peak]);
+        }
+    }
+
+    juce::dsp::FFT fft;
+    double deviceSampleRate = 44100.0;
+    std::vector<float> data;          // Interleaved spectrum in, samples out
+    std::vector<float> binMagnitude;
+    std::vector<float> binFrequency;
+    std::vector<int> peaks;           // Bins of the spectral peaks, for forEachBinByPeak
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralMorph)
+};
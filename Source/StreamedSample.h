@@ -0,0 +1,260 @@
+/*
+  ==============================================================================
+
+    StreamedSample.h
+    Created: 9 Apr 2024 2:51:10pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "SampleData.h"
+
+// Direct-from-disk playback for long files. Only the first few hundred ms
+// (the head) stay decoded in memory, so a note can start at once; everything
+// after that is read into a small ring buffer per source by the shared
+// read-ahead thread. Memory use is the same however long the file is.
+class StreamedSample : public SampleData
+{
+public:
+    static Ptr create(juce::AudioFormatManager& formatManager, const juce::File& file,
+                      juce::Time modified, double headMilliseconds)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+        if (reader == nullptr || reader->lengthInSamples <= 0)
+            return nullptr;
+
+        juce::ReferenceCountedObjectPtr<StreamedSample> sample = new StreamedSample(formatManager, file, modified, *reader);
+
+        const auto headLength = (int) juce::jmin(reader->lengthInSamples,
+                                                 (juce::int64) (reader->sampleRate * headMilliseconds / 1000.0));
+        sample->head.setSize((int) reader->numChannels, headLength);
+        reader->read(&sample->head, 0, headLength, 0, true, true);
+        return sample.get();
+    }
+
+    size_t getSizeInBytes() const override
+    {
+        return (size_t) head.getNumChannels() * (size_t) head.getNumSamples() * sizeof(float);
+    }
+
+    std::unique_ptr<juce::PositionableAudioSource> createSource(PlaybackContext& context) override;
+
+    juce::AudioFormatReader* createReader() const { return formatManager.createReaderFor(file); }
+
+    juce::AudioFormatManager& formatManager;
+    const juce::int64 lengthInSamples;
+    const int numChannels;
+    juce::AudioBuffer<float> head;
+
+private:
+    StreamedSample(juce::AudioFormatManager& manager, const juce::File& f, juce::Time modified,
+                   const juce::AudioFormatReader& reader)
+        : SampleData(f, modified, reader.sampleRate),
+          formatManager(manager),
+          lengthInSamples(reader.lengthInSamples),
+          numChannels((int) reader.numChannels)
+    {
+    }
+};
+
+// One play cursor over a StreamedSample, with its own reader and ring buffer.
+//
+// The audio thread is the only consumer and the read-ahead thread the only
+// producer. When the audio thread jumps (a note restarting the sample), it
+// bumps seekGeneration; the producer notices, restarts the ring at the new
+// position and only then publishes the matching generation, so the audio
+// thread never plays data left over from before the jump. Until the ring has
+// caught up the head covers the start of the file; if it runs dry anyway the
+// block is padded with silence and counted as an underrun.
+//
+// Every voice has its own source per corner, so a source stays idle until it
+// is first told where to play from. Only then does the read-ahead thread open
+// its reader and allocate its ring, so voices that never sound cost no file
+// handle and no ring. A voice that has played keeps both until the set is
+// replaced: about 256 KB of ring per corner in stereo, so up to 1 MB per
+// voice that has sounded in the current set.
+class StreamingSampleSource : public juce::PositionableAudioSource,
+                              private juce::TimeSliceClient
+{
+public:
+    StreamingSampleSource(juce::ReferenceCountedObjectPtr<StreamedSample> s, SampleData::PlaybackContext& context)
+        : sample(std::move(s)),
+          readAheadThread(context.readAheadThread), underrunCounter(context.streamUnderruns)
+    {
+        readAheadThread.addTimeSliceClient(this);
+    }
+
+    ~StreamingSampleSource() override
+    {
+        readAheadThread.removeTimeSliceClient(this);
+    }
+
+    void prepareToPlay(int, double) override {}
+    void releaseResources() override {}
+
+    // Audio thread
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+    {
+        auto position = nextReadPosition.load(std::memory_order_relaxed);
+        const auto headLength = (juce::int64) sample->head.getNumSamples();
+        int done = 0;
+
+        // From the resident head
+        if (position < headLength)
+        {
+            const auto num = (int) juce::jmin((juce::int64) info.numSamples, headLength - position);
+            copyFrom(sample->head, (int) position, *info.buffer, info.startSample, num);
+            done += num;
+        }
+
+        // From the ring
+        const auto wanted = (int) juce::jlimit((juce::int64) 0, (juce::int64) (info.numSamples - done),
+                                               sample->lengthInSamples - (position + done));
+
+        if (wanted > 0)
+        {
+            const auto start = position + done;
+            juce::int64 available = 0;
+
+            if (producerGeneration.load(std::memory_order_acquire) == seekGeneration.load(std::memory_order_relaxed)
+                 && start >= ringStart.load(std::memory_order_acquire))
+                available = juce::jlimit((juce::int64) 0, (juce::int64) wanted,
+                                         validEnd.load(std::memory_order_acquire) - start);
+
+            for (int i = 0; i < (int) available;)
+            {
+                const auto ringIndex = (int) ((start + i) % ringSize);
+                const auto num = juce::jmin((int) available - i, ringSize - ringIndex);
+                copyFrom(ring, ringIndex, *info.buffer, info.startSample + done + i, num);
+                i += num;
+            }
+
+            if (available < wanted)
+                underrunCounter.fetch_add(1, std::memory_order_relaxed);
+
+            clear(*info.buffer, info.startSample + done + (int) available, wanted - (int) available);
+            done += wanted;
+        }
+
+        // Past the end of the file
+        clear(*info.buffer, info.startSample + done, info.numSamples - done);
+
+        nextReadPosition.store(position + info.numSamples, std::memory_order_release);
+    }
+
+    // Audio thread
+    void setNextReadPosition(juce::int64 newPosition) override
+    {
+        nextReadPosition.store(newPosition, std::memory_order_release);
+        seekGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    juce::int64 getNextReadPosition() const override { return nextReadPosition.load(); }
+    juce::int64 getTotalLength() const override      { return sample->lengthInSamples; }
+    bool isLooping() const override                  { return false; }
+
+private:
+    // Read-ahead thread
+    int useTimeSlice() override
+    {
+        const auto generation = seekGeneration.load(std::memory_order_acquire);
+
+        if (generation == 0)
+            return 50; // Never played yet
+
+        // First play. The audio thread won't touch the ring until a generation
+        // is published below, after it exists.
+        if (reader == nullptr)
+        {
+            if (readerFailed)
+                return 500;
+
+            reader.reset(sample->createReader());
+
+            if (reader == nullptr)
+            {
+                readerFailed = true;
+                return 500;
+            }
+
+            ring.setSize(juce::jmax(1, sample->numChannels), ringSize);
+        }
+
+        if (generation != producerGeneration.load(std::memory_order_relaxed))
+        {
+            // Start over just after the head, or wherever the audio thread jumped to
+            const auto start = juce::jmax(nextReadPosition.load(std::memory_order_acquire),
+                                          (juce::int64) sample->head.getNumSamples());
+            validEnd.store(start, std::memory_order_release);
+            ringStart.store(start, std::memory_order_release);
+            producerGeneration.store(generation, std::memory_order_release);
+        }
+
+        const auto writeFrom = validEnd.load(std::memory_order_relaxed);
+        const auto consumer = juce::jmax(nextReadPosition.load(std::memory_order_acquire),
+                                         ringStart.load(std::memory_order_relaxed));
+        const auto writeTo = juce::jmin(consumer + ringSize, sample->lengthInSamples);
+
+        if (writeTo - writeFrom < minimumChunk && writeTo < sample->lengthInSamples)
+            return 5; // Ring is full enough
+
+        if (writeFrom >= writeTo)
+            return 20; // Read to the end of the file
+
+        const auto num = (int) juce::jmin((juce::int64) maximumChunk, writeTo - writeFrom);
+        const auto ringIndex = (int) (writeFrom % ringSize);
+        const auto first = juce::jmin(num, ringSize - ringIndex);
+
+        reader->read(&ring, ringIndex, first, writeFrom, true, true);
+
+        if (first < num)
+            reader->read(&ring, 0, num - first, writeFrom + first, true, true);
+
+        // Don't publish data the audio thread has already jumped away from
+        if (seekGeneration.load(std::memory_order_acquire) == generation)
+            validEnd.store(writeFrom + num, std::memory_order_release);
+
+        return 0;
+    }
+
+    static void copyFrom(const juce::AudioBuffer<float>& source, int sourceStart,
+                         juce::AudioBuffer<float>& dest, int destStart, int num)
+    {
+        for (int channel = 0; channel < dest.getNumChannels(); ++channel)
+            dest.copyFrom(channel, destStart, source, channel % source.getNumChannels(), sourceStart, num);
+    }
+
+    static void clear(juce::AudioBuffer<float>& dest, int start, int num)
+    {
+        if (num > 0)
+            dest.clear(start, num);
+    }
+
+    static constexpr int ringSize = 32768;
+    static constexpr int minimumChunk = 2048;
+    static constexpr int maximumChunk = 8192;
+
+    juce::ReferenceCountedObjectPtr<StreamedSample> sample;
+    std::unique_ptr<juce::AudioFormatReader> reader; // Read-ahead thread only, opened on first play
+    bool readerFailed = false;                       // Read-ahead thread only
+    juce::TimeSliceThread& readAheadThread;
+    std::atomic<int>& underrunCounter;
+    juce::AudioBuffer<float> ring; // Sized on first play, before any generation is published
+
+    std::atomic<juce::int64> nextReadPosition { 0 };
+    std::atomic<juce::int64> ringStart { 0 }, validEnd { 0 };
+    std::atomic<juce::uint32> seekGeneration { 0 }, producerGeneration { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamingSampleSource)
+};
+
+inline std::unique_ptr<juce::PositionableAudioSource> StreamedSample::createSource(PlaybackContext& context)
+{
+    return std::make_unique<StreamingSampleSource>(this, context);
+}
@@ -0,0 +1,463 @@
+/*
+  ==============================================================================
+
+    VoiceEngine.h
+    Created: 30 Apr 2024 7:05:52pm
+    Author:  MacBook Pro
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "EngineSnapshot.h"
+#include "GranularEngine.h"
+
+// What every voice is rendered with, set once per block
+struct VoiceRenderSettings
+{
+    bool looping = true;
+    double pitchBend = 1.0; // Speed multiplier from the pitch wheel
+    SamplePlayer::Interpolation interpolation = SamplePlayer::Interpolation::hermite;
+};
+
+// One note: an envelope plus a cursor into each of the four corners. A voice
+// owns no audio; it plays through the corner players with its own index in
+// the EngineSnapshot it was started in, and stays with that snapshot until it
+// ends, even after a newer one has taken over.
+class SpecterVoice
+{
+public:
+    // Off the audio thread
+    void prepare(int index, double sampleRate, int maximumBlockSize, int numChannels)
+    {
+        slot = index;
+        adsr.setSampleRate(sampleRate);
+        for (auto& cornerScratch : scratch)
+            cornerScratch.setSize(numChannels, maximumBlockSize);
+        envelope.assign((size_t) maximumBlockSize, 0.0f);
+        spectralStream.prepare();
+        kill();
+    }
+
+    void start(EngineSnapshot& snapshot, int noteNumber, const juce::ADSR::Parameters& parameters, juce::uint32 order)
+    {
+        engine = &snapshot;
+        speed = std::pow(2.0, (noteNumber - 60) / 12.0);
+
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+        {
+            auto& player = snapshot.players[slot][c];
+            cornerFinished[c] = player.source == nullptr;
+
+            if (! cornerFinished[c])
+                player.restart(speed);
+        }
+
+        grainStream.reset();
+        spectralStream.reset();
+        note = noteNumber;
+        startOrder = order;
+        released = false;
+        fadingOut = false;
+        adsr.setParameters(parameters);
+        adsr.noteOn(); // Carries on from the current level if the voice was stolen
+    }
+
+    void stop()
+    {
+        released = true;
+        adsr.noteOff();
+    }
+
+    // Releases over a few milliseconds whatever the envelope's own release
+    // time is, for a voice that has to make room without a click
+    void fadeOut()
+    {
+        auto parameters = adsr.getParameters();
+        parameters.release = fadeOutSeconds;
+        adsr.setParameters(parameters);
+        fadingOut = true;
+        stop();
+    }
+
+    void kill()
+    {
+        adsr.reset();
+        engine = nullptr;
+        note = -1;
+        released = false;
+        fadingOut = false;
+        level = 0.0f;
+    }
+
+    // Adds this voice into the four corner buffers. numSamples must not be
+    // more than the block size given to prepare().
+    void render(juce::AudioBuffer<float>* cornerBuffers, int startSample, int numSamples, const VoiceRenderSettings& settings)
+    {
+        beginRender(numSamples);
+
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+        {
+            renderCorner(c, numSamples, settings);
+            mixCorner(c, cornerBuffers[c], startSample, numSamples);
+        }
+
+        endRender();
+    }
+
+    // render() in three steps, so the corners can be rendered on different
+    // threads: beginRender and endRender once per voice, and renderCorner
+    // then mixCorner for each corner. Different corners never share state.
+    void beginRender(int numSamples)
+    {
+        jassert(numSamples <= (int) envelope.size());
+
+        for (int i = 0; i < numSamples; ++i)
+            envelope[(size_t) i] = adsr.getNextSample();
+
+        level = envelope[(size_t) numSamples - 1];
+    }
+
+    void renderCorner(int c, int numSamples, const VoiceRenderSettings& settings)
+    {
+        cornerRendered[c] = ! cornerFinished[c];
+
+        if (cornerFinished[c])
+            return;
+
+        auto& player = engine->players[slot][c];
+        player.setSpeed(speed * settings.pitchBend);
+        player.player.setInterpolation(settings.interpolation);
+        player.player.process(scratch[c], 0, numSamples);
+
+        if (player.hasReachedEnd())
+        {
+            if (settings.looping)
+                player.rewind(); // Loop back to the start
+            else
+                cornerFinished[c] = true;
+        }
+    }
+
+    void mixCorner(int c, juce::AudioBuffer<float>& corner, int startSample, int numSamples) const
+    {
+        if (! cornerRendered[c])
+            return;
+
+        for (int channel = 0; channel < corner.getNumChannels(); ++channel)
+            juce::FloatVectorOperations::addWithMultiply(corner.getWritePointer(channel, startSample),
+                                                         scratch[c].getReadPointer(channel % scratch[c].getNumChannels()),
+                                                         envelope.data(), numSamples);
+    }
+
+    void endRender()
+    {
+        bool anyCornerPlaying = false;
+
+        for (auto finished : cornerFinished)
+            anyCornerPlaying = anyCornerPlaying || ! finished;
+
+        if (! adsr.isActive() || ! anyCornerPlaying)
+            kill();
+    }
+
+    // Instead of render(), when the voice plays grains rather than the corners.
+    // blockOffset is where this stretch starts in the next GranularEngine render.
+    void renderGrains(GranularEngine& granular, int blockOffset, int numSamples,
+                      const float* cornerWeights, const GranularEngine::Settings& grainSettings,
+                      const VoiceRenderSettings& settings)
+    {
+        beginRender(numSamples);
+        granular.schedule(*engine, grainStream, blockOffset, numSamples, speed * settings.pitchBend,
+                          envelope.data(), cornerWeights, grainSettings);
+
+        if (! adsr.isActive())
+            kill();
+    }
+
+    // Instead of render(), when the voice plays the spectral morph. Adds
+    // straight into the output; scratch only holds the mono morph.
+    void renderSpectral(SpectralMorph& morph, juce::AudioBuffer<float>& output,
+                        int startSample, int numSamples, const float* cornerWeights, const VoiceRenderSettings& settings)
+    {
+        beginRender(numSamples);
+
+        // Corners whose frames aren't built yet sit the morph out until they are
+        const SpectralFrames* frames[EngineSnapshot::numCorners];
+
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+            frames[c] = engine->getSpectralFrames(c);
+
+        auto* morphed = scratch[0].getWritePointer(0);
+        const auto pitch = juce::jlimit(CornerPlayer::minSpeed, CornerPlayer::maxSpeed, speed * settings.pitchBend);
+        morph.render(frames, spectralStream, morphed, numSamples, pitch, cornerWeights, settings.looping);
+
+        for (int channel = 0; channel < output.getNumChannels(); ++channel)
+            juce::FloatVectorOperations::addWithMultiply(output.getWritePointer(channel, startSample),
+                                                         morphed, envelope.data(), numSamples);
+
+        if (! adsr.isActive() || (! settings.looping && SpectralMorph::hasReachedEnd(frames, spectralStream)))
+            kill();
+    }
+
+    bool isActive() const     { return note >= 0; }
+    bool isReleased() const   { return released; }
+    bool isFadingOut() const  { return fadingOut; }
+    int getNote() const       { return note; }
+    bool isUsing(const EngineSnapshot& snapshot) const { return engine == &snapshot; }
+    float getLevel() const    { return level; }
+    juce::uint32 getStartOrder() const { return startOrder; }
+
+    // How far through the corner's file this voice is, or -1 if it has no sample
+    float getPlayhead(int corner) const
+    {
+        const auto& player = engine->players[slot][corner];
+        return player.source != nullptr ? (float) player.getProportionPlayed() : -1.0f;
+    }
+
+private:
+    static constexpr float fadeOutSeconds = 0.005f;
+
+    EngineSnapshot* engine = nullptr; // The snapshot this voice was started in, while it sounds
+    int slot = 0;
+    int note = -1;
+    double speed = 1.0;
+    bool released = false;
+    bool fadingOut = false; // Making room, so it no longer counts against the polyphony
+    float level = 0.0f; // Envelope at the end of the last block, for picking a voice to steal
+    juce::uint32 startOrder = 0;
+    bool cornerFinished[EngineSnapshot::numCorners] = {};
+    bool cornerRendered[EngineSnapshot::numCorners] = {}; // Has output from the current render in scratch
+    juce::ADSR adsr;
+    juce::AudioBuffer<float> scratch[EngineSnapshot::numCorners]; // One per corner, so corners can render in parallel
+    std::vector<float> envelope;
+    GranularEngine::Stream grainStream;
+    SpectralMorph::Stream spectralStream;
+};
+
+// A fixed pool of voices, all allocated in prepare(). Note-ons take a free
+// voice while fewer than the polyphony limit are sounding; past that they
+// steal the quietest voice that is already releasing, or else the oldest one.
+// Lowering the polyphony fades the voices over the limit out quickly rather
+// than cutting them, and they stop counting against it straight away.
+// Everything apart from prepare() is for the audio thread.
+class VoiceEngine
+{
+public:
+    static constexpr int maxVoices = EngineSnapshot::maxVoices;
+
+    VoiceEngine() = default;
+
+    void prepare(double sampleRate, int maximumBlockSize, int numChannels)
+    {
+        blockSize = juce::jmax(1, maximumBlockSize);
+
+        for (int i = 0; i < maxVoices; ++i)
+            voices[i].prepare(i, sampleRate, blockSize, numChannels);
+    }
+
+    void setPolyphony(int numVoices)
+    {
+        polyphony = juce::jlimit(1, maxVoices, numVoices);
+
+        // Let go of anything over the new limit, oldest first
+        for (int held = getNumVoicesHeld(); held > polyphony; --held)
+            if (auto* voice = findVoiceToSteal(false))
+                voice->fadeOut();
+    }
+
+    void setEnvelope(const juce::ADSR::Parameters& newParameters) { envelopeParameters = newParameters; }
+
+    void noteOn(EngineSnapshot& engine, int noteNumber)
+    {
+        SpecterVoice* voice = nullptr;
+
+        if (getNumVoicesHeld() < polyphony)
+            for (auto& v : voices)
+                if (! v.isActive()) { voice = &v; break; }
+
+        if (voice == nullptr)
+            voice = findVoiceToSteal(true);
+
+        if (voice != nullptr)
+            voice->start(engine, noteNumber, envelopeParameters, nextStartOrder++);
+    }
+
+    void noteOff(int noteNumber)
+    {
+        for (auto& voice : voices)
+            if (voice.isActive() && ! voice.isReleased() && voice.getNote() == noteNumber)
+                voice.stop();
+    }
+
+    void allNotesOff()
+    {
+        for (auto& voice : voices)
+            if (voice.isActive())
+                voice.stop();
+    }
+
+    // True while any voice still plays from the snapshot
+    bool isUsing(const EngineSnapshot& snapshot) const
+    {
+        for (auto& voice : voices)
+            if (voice.isActive() && voice.isUsing(snapshot))
+                return true;
+
+        return false;
+    }
+
+    // Adds every sounding voice into the corner buffers, each from its own snapshot
+    void render(juce::AudioBuffer<float>* cornerBuffers, int startSample, int numSamples, const VoiceRenderSettings& settings)
+    {
+        for (auto& voice : voices)
+        {
+            // In chunks, in case the host sends more than it said it would
+            for (int done = 0; voice.isActive() && done < numSamples;)
+            {
+                const int num = juce::jmin(blockSize, numSamples - done);
+                voice.render(cornerBuffers, startSample + done, num, settings);
+                done += num;
+            }
+        }
+    }
+
+    // Has every sounding voice start its grains for the range. The grains
+    // themselves are rendered by the GranularEngine.
+    void renderGrains(GranularEngine& granular, int numSamples, const float* cornerWeights,
+                      const GranularEngine::Settings& grainSettings, const VoiceRenderSettings& settings)
+    {
+        for (auto& voice : voices)
+        {
+            for (int done = 0; voice.isActive() && done < numSamples;)
+            {
+                const int num = juce::jmin(blockSize, numSamples - done);
+                voice.renderGrains(granular, done, num, cornerWeights, grainSettings, settings);
+                done += num;
+            }
+        }
+    }
+
+    // Adds every sounding voice's spectral morph into the output
+    void renderSpectral(SpectralMorph& morph, juce::AudioBuffer<float>& output,
+                        int startSample, int numSamples, const float* cornerWeights, const VoiceRenderSettings& settings)
+    {
+        for (auto& voice : voices)
+        {
+            for (int done = 0; voice.isActive() && done < numSamples;)
+            {
+                const int num = juce::jmin(blockSize, numSamples - done);
+                voice.renderSpectral(morph, output, startSample + done, num, cornerWeights, settings);
+                done += num;
+            }
+        }
+    }
+
+    // The same render split into steps for RenderWorkerPool. beginRender
+    // returns the number of voices taking part; every task from 0 to that
+    // times numCorners then goes to renderTask, every corner to mixCorner,
+    // and endRender finishes off. numSamples must fit the prepared block size.
+    int beginRender(int numSamples)
+    {
+        jassert(numSamples <= blockSize);
+        numRendering = 0;
+
+        for (auto& voice : voices)
+        {
+            if (voice.isActive())
+            {
+                voice.beginRender(numSamples);
+                rendering[numRendering++] = &voice;
+            }
+        }
+
+        return numRendering;
+    }
+
+    void renderTask(int task, int numSamples, const VoiceRenderSettings& settings)
+    {
+        rendering[task / EngineSnapshot::numCorners]->renderCorner(task % EngineSnapshot::numCorners, numSamples, settings);
+    }
+
+    void mixCorner(int corner, juce::AudioBuffer<float>& cornerBuffer, int startSample, int numSamples) const
+    {
+        for (int i = 0; i < numRendering; ++i)
+            rendering[i]->mixCorner(corner, cornerBuffer, startSample, numSamples);
+    }
+
+    void endRender()
+    {
+        for (int i = 0; i < numRendering; ++i)
+            rendering[i]->endRender();
+
+        numRendering = 0;
+    }
+
+    int getBlockSize() const { return blockSize; }
+
+    // Where the newest voice sounding from the snapshot is in each corner's
+    // file, -1 where nothing is playing
+    void getCornerPlayheads(const EngineSnapshot& engine, float* playheads) const
+    {
+        const SpecterVoice* newest = nullptr;
+
+        for (auto& voice : voices)
+            if (voice.isActive() && voice.isUsing(engine) && (newest == nullptr || voice.getStartOrder() - newest->getStartOrder() < 0x80000000u))
+                newest = &voice;
+
+        for (int c = 0; c < EngineSnapshot::numCorners; ++c)
+            playheads[c] = newest != nullptr ? newest->getPlayhead(c) : -1.0f;
+    }
+
+    int getNumActiveVoices() const
+    {
+        int active = 0;
+        for (auto& voice : voices)
+            active += voice.isActive() ? 1 : 0;
+        return active;
+    }
+
+private:
+    // Voices sounding that count against the polyphony
+    int getNumVoicesHeld() const
+    {
+        int held = 0;
+        for (auto& voice : voices)
+            held += voice.isActive() && ! voice.isFadingOut() ? 1 : 0;
+        return held;
+    }
+
+    // Voices already fading out are only candidates if includeFading is set
+    SpecterVoice* findVoiceToSteal(bool includeFading)
+    {
+        SpecterVoice* quietestReleased = nullptr;
+        SpecterVoice* oldest = nullptr;
+
+        for (auto& voice : voices)
+        {
+            if (! voice.isActive() || (voice.isFadingOut() && ! includeFading))
+                continue;
+
+            if (voice.isReleased() && (quietestReleased == nullptr || voice.getLevel() < quietestReleased->getLevel()))
+                quietestReleased = &voice;
+
+            // Started before the current oldest, allowing for the counter wrapping around
+            if (oldest == nullptr || voice.getStartOrder() - oldest->getStartOrder() > 0x80000000u)
+                oldest = &voice;
+        }
+
+        return quietestReleased != nullptr ? quietestReleased : oldest;
+    }
+
+    SpecterVoice voices[maxVoices];
+    SpecterVoice* rendering[maxVoices] = {}; // The voices between beginRender and endRender
+    int numRendering = 0;
+    juce::ADSR::Parameters envelopeParameters;
+    int polyphony = 8;
+    int blockSize = 512;
+    juce::uint32 nextStartOrder = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceEngine)
+};
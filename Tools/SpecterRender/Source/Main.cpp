@@ -0,0 +1,338 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 21 May 2024 5:48:03pm
+    Author:  MacBook Pro
+
+    Renders Specter without a host or editor: four sample files, a MIDI file
+    and an XY trajectory in, a WAV file and timing figures out.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+
+namespace
+{
+    struct Options
+    {
+        juce::Array<juce::File> files;
+        juce::File midiFile, trajectoryFile, outputFile { juce::File::getCurrentWorkingDirectory().getChildFile("specter-render.wav") };
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        int subBlockSize = 128;
+        int renderWorkers = 0;
+        double seconds = 0.0; // 0 means the length of the MIDI file plus a tail
+        double rndMixSeconds = 0.0; // Above 0, Rnd Mix moves the mix instead of the --xy trajectory
+        juce::String loadMode = "Decoded";
+        juce::String interpolation = "Cubic Hermite";
+    };
+
+    void printUsage()
+    {
+        std::cout << "Usage: SpecterRender --files a.wav b.wav c.wav d.wav [options]\n\n"
+                     "  --midi file.mid         Notes to play (default: middle C held throughout)\n"
+                     "  --xy trajectory.csv     Lines of 'seconds,x,y', x and y in 0..1 (default: a slow circle)\n"
+                     "  --out render.wav        Where to write the result\n"
+                     "  --rate 48000            Sample rate\n"
+                     "  --block 512             Host block size\n"
+                     "  --subblock 128          Longest sub-block the processor renders in one go\n"
+                     "  --threads 0             Render workers besides the audio thread (default: none)\n"
+                     "  --seconds 10            Length (default: the MIDI file plus two seconds)\n"
+                     "  --rnd-mix 1.0           Let Rnd Mix move the mix, this many seconds per segment, always the same path\n"
+                     "  --load-mode Decoded     Decoded, Memory-mapped or Streamed\n"
+                     "  --interpolation \"Cubic Hermite\"   Linear, Cubic Hermite or Windowed Sinc\n";
+    }
+
+    bool parseArguments(const juce::StringArray& args, Options& options)
+    {
+        for (int i = 0; i < args.size(); ++i)
+        {
+            const auto& arg = args[i];
+            const auto next = [&] { return i + 1 < args.size() ? args[++i] : juce::String(); };
+            const auto file = [&] { return juce::File::getCurrentWorkingDirectory().getChildFile(next()); };
+
+            if (arg == "--files")
+            {
+                while (i + 1 < args.size() && ! args[i + 1].startsWith("--"))
+                    options.files.add(file());
+            }
+            else if (arg == "--midi")           options.midiFile = file();
+            else if (arg == "--xy")             options.trajectoryFile = file();
+            else if (arg == "--out")            options.outputFile = file();
+            else if (arg == "--rate")           options.sampleRate = next().getDoubleValue();
+            else if (arg == "--block")          options.blockSize = next().getIntValue();
+            else if (arg == "--subblock")       options.subBlockSize = next().getIntValue();
+            else if (arg == "--threads")        options.renderWorkers = next().getIntValue();
+            else if (arg == "--seconds")        options.seconds = next().getDoubleValue();
+            else if (arg == "--rnd-mix")        options.rndMixSeconds = next().getDoubleValue();
+            else if (arg == "--load-mode")      options.loadMode = next();
+            else if (arg == "--interpolation")  options.interpolation = next();
+            else
+            {
+                std::cout << "Unknown option " << arg << "\n\n";
+                return false;
+            }
+        }
+
+        return options.files.size() == 4 && options.sampleRate > 0.0 && options.blockSize > 0;
+    }
+
+    // The notes, in seconds, all tracks merged
+    juce::MidiMessageSequence readMidi(const juce::File& file)
+    {
+        juce::MidiMessageSequence sequence;
+        juce::FileInputStream stream(file);
+        juce::MidiFile midiFile;
+
+        if (stream.openedOk() && midiFile.readFrom(stream))
+        {
+            midiFile.convertTimestampTicksToSeconds();
+
+            for (int track = 0; track < midiFile.getNumTracks(); ++track)
+                sequence.addSequence(*midiFile.getTrack(track), 0.0);
+
+            sequence.updateMatchedPairs();
+        }
+        else
+        {
+            std::cout << "Couldn't read " << file.getFullPathName() << "\n";
+        }
+
+        return sequence;
+    }
+
+    // Where the ball is over time: straight lines between the points in the
+    // file, or a circle round the middle of the pad every eight seconds
+    struct Trajectory
+    {
+        explicit Trajectory(const juce::File& file)
+        {
+            juce::StringArray lines;
+            file.readLines(lines);
+
+            for (const auto& line : lines)
+            {
+                const auto fields = juce::StringArray::fromTokens(line, ",", "");
+
+                if (fields.size() >= 3 && fields[0].trim().containsOnly("0123456789.-"))
+                    points.add({ fields[0].getDoubleValue(), fields[1].getFloatValue(), fields[2].getFloatValue() });
+            }
+        }
+
+        juce::Point<float> at(double time) const
+        {
+            if (points.isEmpty())
+            {
+                const auto angle = juce::MathConstants<double>::twoPi * time / 8.0;
+                return { 0.5f + 0.4f * (float) std::cos(angle), 0.5f + 0.4f * (float) std::sin(angle) };
+            }
+
+            if (time <= points.getFirst().time)
+                return points.getFirst().position();
+
+            for (int i = 1; i < points.size(); ++i)
+            {
+                const auto& a = points.getReference(i - 1);
+                const auto& b = points.getReference(i);
+
+                if (time < b.time)
+                {
+                    const auto t = (float) ((time - a.time) / juce::jmax(1.0e-9, b.time - a.time));
+                    return a.position() + (b.position() - a.position()) * t;
+                }
+            }
+
+            return points.getLast().position();
+        }
+
+        struct Point
+        {
+            double time;
+            float x, y;
+            juce::Point<float> position() const { return { x, y }; }
+        };
+
+        juce::Array<Point> points;
+    };
+
+    void setChoice(SpecterAudioProcessor& processor, const juce::String& parameterID, const juce::String& choice)
+    {
+        if (auto* parameter = dynamic_cast<juce::AudioParameterChoice*>(processor.apvts.getParameter(parameterID)))
+        {
+            const auto index = parameter->choices.indexOf(choice, true);
+
+            if (index >= 0)
+                parameter->setValueNotifyingHost(parameter->convertTo0to1((float) index));
+            else
+                std::cout << "Unknown " << parameterID << " '" << choice << "', using " << parameter->getCurrentChoiceName() << "\n";
+        }
+    }
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+
+        const auto index = (size_t) juce::jlimit(0.0, (double) sorted.size() - 1.0, std::ceil(p / 100.0 * sorted.size()) - 1.0);
+        return sorted[index];
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The processor uses timers and the message thread
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+    juce::StringArray args;
+
+    for (int i = 1; i < argc; ++i)
+        args.add(juce::CharPointer_UTF8(argv[i]));
+
+    if (! parseArguments(args, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    SpecterAudioProcessor processor;
+    processor.setPlayConfigDetails(0, 2, options.sampleRate, options.blockSize);
+    processor.setNonRealtime(true);
+    setChoice(processor, "loadMode", options.loadMode);
+    setChoice(processor, "interpolation", options.interpolation);
+
+    // A fixed seed, so the same options always render the same path
+    if (options.rndMixSeconds > 0.0)
+    {
+        processor.setParameterValue("rndMixTime", (float) options.rndMixSeconds);
+        processor.startRandomMix(1);
+    }
+    processor.setMaxSubBlockSize(options.subBlockSize);
+    processor.setNumRenderWorkers(options.renderWorkers);
+    processor.prepareToPlay(options.sampleRate, options.blockSize);
+
+    // Loading happens on the processor's own thread; wait for it to hand over
+    const auto loadStart = juce::Time::getMillisecondCounterHiRes();
+    processor.loadFiles(options.files);
+
+    while (processor.getNumSetsLoaded() == 0)
+    {
+        if (juce::Time::getMillisecondCounterHiRes() - loadStart > 60000.0)
+        {
+            std::cout << "Timed out loading the files\n";
+            return 1;
+        }
+
+        juce::MessageManager::getInstance()->runDispatchLoopUntil(5);
+    }
+
+    std::cout << "Loaded in " << juce::String(juce::Time::getMillisecondCounterHiRes() - loadStart, 1) << " ms\n";
+
+    // What to play
+    juce::MidiMessageSequence notes;
+
+    if (options.midiFile != juce::File())
+    {
+        notes = readMidi(options.midiFile);
+    }
+    else
+    {
+        notes.addEvent(juce::MidiMessage::noteOn(1, 60, 1.0f), 0.0);
+        notes.addEvent(juce::MidiMessage::noteOff(1, 60), options.seconds > 0.0 ? options.seconds : 10.0);
+    }
+
+    const auto seconds = options.seconds > 0.0 ? options.seconds : notes.getEndTime() + 2.0;
+    const auto totalSamples = (juce::int64) (seconds * options.sampleRate);
+    const Trajectory trajectory(options.trajectoryFile);
+
+    // Where the result goes
+    options.outputFile.deleteFile();
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    if (auto stream = std::make_unique<juce::FileOutputStream>(options.outputFile); stream->openedOk())
+    {
+        writer.reset(juce::WavAudioFormat().createWriterFor(stream.get(), options.sampleRate, 2, 24, {}, 0));
+
+        // The writer only takes the stream over if it was created
+        if (writer != nullptr)
+            stream.release();
+    }
+
+    if (writer == nullptr)
+    {
+        std::cout << "Couldn't write " << options.outputFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    // Render
+    juce::AudioBuffer<float> buffer(2, options.blockSize);
+    juce::MidiBuffer midi;
+    std::vector<double> blockTimes;
+    blockTimes.reserve((size_t) (totalSamples / options.blockSize + 1));
+    int nextNote = 0;
+
+    for (juce::int64 position = 0; position < totalSamples; position += options.blockSize)
+    {
+        const auto numSamples = (int) juce::jmin((juce::int64) options.blockSize, totalSamples - position);
+        const auto blockStart = position / options.sampleRate;
+        const auto blockEnd = (position + numSamples) / options.sampleRate;
+
+        midi.clear();
+
+        for (; nextNote < notes.getNumEvents(); ++nextNote)
+        {
+            const auto& message = notes.getEventPointer(nextNote)->message;
+
+            if (message.getTimeStamp() >= blockEnd)
+                break;
+
+            const auto offset = (int) ((message.getTimeStamp() - blockStart) * options.sampleRate);
+            midi.addEvent(message, juce::jlimit(0, numSamples - 1, offset));
+        }
+
+        if (options.rndMixSeconds <= 0.0)
+        {
+            const auto xy = trajectory.at(blockStart);
+            processor.setMixPosition(xy.x, xy.y);
+        }
+
+        buffer.setSize(2, numSamples, false, false, true);
+        buffer.clear();
+
+        const auto start = juce::Time::getHighResolutionTicks();
+        processor.processBlock(buffer, midi);
+        const auto end = juce::Time::getHighResolutionTicks();
+
+        blockTimes.push_back(juce::Time::highResolutionTicksToSeconds(end - start) * 1000.0);
+        writer->writeFromAudioSampleBuffer(buffer, 0, numSamples);
+    }
+
+    processor.releaseResources();
+    writer.reset();
+
+    // Report
+    const auto totalMs = std::accumulate(blockTimes.begin(), blockTimes.end(), 0.0);
+    const auto budgetMs = options.blockSize / options.sampleRate * 1000.0;
+    const auto overBudget = std::count_if(blockTimes.begin(), blockTimes.end(), [budgetMs] (double t) { return t > budgetMs; });
+    std::sort(blockTimes.begin(), blockTimes.end());
+
+    std::cout << "Rendered " << juce::String(seconds, 2) << " s at " << options.sampleRate << " Hz, block "
+              << options.blockSize << ", sub-block " << options.subBlockSize << ", "
+              << processor.getNumRenderWorkers() << " render workers to "
+              << options.outputFile.getFullPathName() << "\n\n"
+              << "block time (ms)  p50 " << juce::String(percentile(blockTimes, 50.0), 4)
+              << "  p90 " << juce::String(percentile(blockTimes, 90.0), 4)
+              << "  p99 " << juce::String(percentile(blockTimes, 99.0), 4)
+              << "  p99.9 " << juce::String(percentile(blockTimes, 99.9), 4)
+              << "  worst " << juce::String(blockTimes.empty() ? 0.0 : blockTimes.back(), 4) << "\n"
+              << "block budget     " << juce::String(budgetMs, 4) << " ms, " << (int) overBudget << " of "
+              << (int) blockTimes.size() << " blocks over\n"
+              << "real-time factor " << juce::String(totalMs / 1000.0 / seconds, 4)
+              << " (processing time / audio time, lower is better)\n"
+              << "stream underruns " << processor.getNumStreamUnderruns() << "\n";
+
+    return 0;
+}